@@ -0,0 +1,228 @@
+#ifndef FAST_WFC_UTILS_SAMPLES_HPP_
+#define FAST_WFC_UTILS_SAMPLES_HPP_
+
+#include <fstream>
+#include <optional>
+#include <string>
+#include <tuple>
+#include <unordered_map>
+#include <unordered_set>
+#include <vector>
+
+#include "color.hpp"
+#include "external/rapidxml.hpp"
+#include "fastwfc/overlapping_wfc.hpp"
+#include "fastwfc/tiling_wfc.hpp"
+#include "image.hpp"
+#include "rapidxml_utils.hpp"
+
+/**
+ * Read the options of an overlapping WFC problem.
+ */
+OverlappingWFCOptions read_overlapping_options(rapidxml::xml_node<> *node) {
+  unsigned N = std::stoi(rapidxml::get_attribute(node, "N"));
+  bool periodic_output =
+      (rapidxml::get_attribute(node, "periodic", "False") == "True");
+  bool periodic_input =
+      (rapidxml::get_attribute(node, "periodicInput", "True") == "True");
+  bool ground = (std::stoi(rapidxml::get_attribute(node, "ground", "0")) != 0);
+  unsigned symmetry =
+      std::stoi(rapidxml::get_attribute(node, "symmetry", "8"));
+  unsigned width = std::stoi(rapidxml::get_attribute(node, "width", "48"));
+  unsigned height = std::stoi(rapidxml::get_attribute(node, "height", "48"));
+  return {periodic_input, periodic_output, height, width, symmetry, ground, N};
+}
+
+/**
+ * Transform a symmetry name into its Symmetry enum
+ */
+Symmetry to_symmetry(const std::string &symmetry_name) {
+  if (symmetry_name == "X") {
+    return Symmetry::X;
+  }
+  if (symmetry_name == "T") {
+    return Symmetry::T;
+  }
+  if (symmetry_name == "I") {
+    return Symmetry::I;
+  }
+  if (symmetry_name == "L") {
+    return Symmetry::L;
+  }
+  if (symmetry_name == "\\") {
+    return Symmetry::backslash;
+  }
+  if (symmetry_name == "P") {
+    return Symmetry::P;
+  }
+  throw symmetry_name + "is an invalid Symmetry";
+}
+
+/**
+ * Read the names of the tiles in the subset in a tiling WFC problem
+ */
+std::optional<std::unordered_set<std::string>>
+read_subset_names(rapidxml::xml_node<> *root_node, const std::string &subset) {
+  std::unordered_set<std::string> subset_names;
+  rapidxml::xml_node<> *subsets_node = root_node->first_node("subsets");
+  if (!subsets_node) {
+    return std::nullopt;
+  }
+  rapidxml::xml_node<> *subset_node = subsets_node->first_node("subset");
+  while (subset_node &&
+         rapidxml::get_attribute(subset_node, "name") != subset) {
+    subset_node = subset_node->next_sibling("subset");
+  }
+  if (!subset_node) {
+    return std::nullopt;
+  }
+  for (rapidxml::xml_node<> *node = subset_node->first_node("tile"); node;
+       node = node->next_sibling("tile")) {
+    subset_names.insert(rapidxml::get_attribute(node, "name"));
+  }
+  return subset_names;
+}
+
+/**
+ * Read all tiles for a tiling problem
+ */
+std::unordered_map<std::string, Tile<Color>>
+read_tiles(rapidxml::xml_node<> *root_node, const std::string &current_dir,
+           const std::string &subset, unsigned size) {
+  std::optional<std::unordered_set<std::string>> subset_names =
+      read_subset_names(root_node, subset);
+  std::unordered_map<std::string, Tile<Color>> tiles;
+  rapidxml::xml_node<> *tiles_node = root_node->first_node("tiles");
+  for (rapidxml::xml_node<> *node = tiles_node->first_node("tile"); node;
+       node = node->next_sibling("tile")) {
+    std::string name = rapidxml::get_attribute(node, "name");
+    if (subset_names != std::nullopt &&
+        subset_names->find(name) == subset_names->end()) {
+      continue;
+    }
+    Symmetry symmetry =
+        to_symmetry(rapidxml::get_attribute(node, "symmetry", "X"));
+    double weight = std::stod(rapidxml::get_attribute(node, "weight", "1.0"));
+    const std::string image_path = current_dir + "/" + name + ".png";
+    std::optional<Array2D<Color>> image = read_image(image_path);
+
+    if (image == std::nullopt) {
+      std::vector<Array2D<Color>> images;
+      for (unsigned i = 0; i < nb_of_possible_orientations(symmetry); i++) {
+        const std::string image_path =
+            current_dir + "/" + name + " " + std::to_string(i) + ".png";
+        std::optional<Array2D<Color>> image = read_image(image_path);
+        if (image == std::nullopt) {
+          throw "Error while loading " + image_path;
+        }
+        if ((image->width != size) || (image->height != size)) {
+          throw "Image " + image_path + " has wrond size";
+        }
+        images.push_back(*image);
+      }
+      Tile<Color> tile = {images, symmetry, weight};
+      tiles.insert({name, tile});
+    } else {
+      if ((image->width != size) || (image->height != size)) {
+        throw "Image " + image_path + " has wrong size";
+      }
+
+      Tile<Color> tile(*image, symmetry, weight);
+      tiles.insert({name, tile});
+    }
+  }
+
+  return tiles;
+}
+
+/**
+ * Read the neighbors constraints for a tiling problem.
+ * A value {t1,o1,t2,o2} means that the tile t1 with orientation o1 can be
+ * placed at the right of the tile t2 with orientation o2.
+ */
+std::vector<std::tuple<std::string, unsigned, std::string, unsigned>>
+read_neighbors(rapidxml::xml_node<> *root_node) {
+  std::vector<std::tuple<std::string, unsigned, std::string, unsigned>>
+      neighbors;
+  rapidxml::xml_node<> *neighbor_node = root_node->first_node("neighbors");
+  for (rapidxml::xml_node<> *node = neighbor_node->first_node("neighbor");
+       node; node = node->next_sibling("neighbor")) {
+    std::string left = rapidxml::get_attribute(node, "left");
+    std::string::size_type left_delimiter = left.find(" ");
+    std::string left_tile = left.substr(0, left_delimiter);
+    unsigned left_orientation = 0;
+    if (left_delimiter != std::string::npos) {
+      left_orientation =
+          std::stoi(left.substr(left_delimiter, std::string::npos));
+    }
+
+    std::string right = rapidxml::get_attribute(node, "right");
+    std::string::size_type right_delimiter = right.find(" ");
+    std::string right_tile = right.substr(0, right_delimiter);
+    unsigned right_orientation = 0;
+    if (right_delimiter != std::string::npos) {
+      right_orientation =
+          std::stoi(right.substr(right_delimiter, std::string::npos));
+    }
+    neighbors.push_back(
+        {left_tile, left_orientation, right_tile, right_orientation});
+  }
+  return neighbors;
+}
+
+/**
+ * The tiles and the neighbors constraints of a tiling WFC problem.
+ */
+struct TilingProblem {
+  std::vector<Tile<Color>> tiles;
+  std::unordered_map<std::string, unsigned> tiles_id;
+  std::vector<std::tuple<unsigned, unsigned, unsigned, unsigned>> neighbors;
+};
+
+/**
+ * Read the tiles of the subset of the tileset name, and their neighbors
+ * constraints, from the tileset directory in dir_path.
+ */
+TilingProblem read_tiling_problem(const std::string &dir_path,
+                                  const std::string &name,
+                                  const std::string &subset) {
+  std::ifstream config_file(dir_path + "/" + name + "/data.xml");
+  std::vector<char> buffer((std::istreambuf_iterator<char>(config_file)),
+                           std::istreambuf_iterator<char>());
+  buffer.push_back('\0');
+  rapidxml::xml_document<> data_document;
+  data_document.parse<0>(&buffer[0]);
+  rapidxml::xml_node<> *data_root_node = data_document.first_node("set");
+  unsigned size = std::stoi(rapidxml::get_attribute(data_root_node, "size"));
+
+  std::unordered_map<std::string, Tile<Color>> tiles_map =
+      read_tiles(data_root_node, dir_path + "/" + name, subset, size);
+  TilingProblem problem;
+  unsigned id = 0;
+  for (std::pair<std::string, Tile<Color>> tile : tiles_map) {
+    problem.tiles_id.insert({tile.first, id});
+    problem.tiles.push_back(tile.second);
+    id++;
+  }
+
+  std::vector<std::tuple<std::string, unsigned, std::string, unsigned>>
+      neighbors = read_neighbors(data_root_node);
+  for (auto neighbor : neighbors) {
+    const std::string &neighbor1 = std::get<0>(neighbor);
+    const int &orientation1 = std::get<1>(neighbor);
+    const std::string &neighbor2 = std::get<2>(neighbor);
+    const int &orientation2 = std::get<3>(neighbor);
+    if (problem.tiles_id.find(neighbor1) == problem.tiles_id.end()) {
+      continue;
+    }
+    if (problem.tiles_id.find(neighbor2) == problem.tiles_id.end()) {
+      continue;
+    }
+    problem.neighbors.push_back(
+        std::make_tuple(problem.tiles_id[neighbor1], orientation1,
+                        problem.tiles_id[neighbor2], orientation2));
+  }
+  return problem;
+}
+
+#endif // FAST_WFC_UTILS_SAMPLES_HPP_
@@ -0,0 +1,405 @@
+#include <algorithm>
+#include <atomic>
+#include <chrono>
+#include <cmath>
+#include <cstdint>
+#include <cstdio>
+#include <cstdlib>
+#include <exception>
+#include <fstream>
+#include <iostream>
+#include <new>
+#include <string>
+#include <vector>
+
+#include "fastwfc/overlapping_wfc.hpp"
+#include "fastwfc/tiling_wfc.hpp"
+#include "external/rapidxml.hpp"
+#include "rapidxml_utils.hpp"
+#include "samples.hpp"
+#include "utils.hpp"
+
+using namespace rapidxml;
+using namespace std;
+
+namespace {
+
+/**
+ * The number of bytes currently allocated on the heap, and the largest value
+ * it reached since the last call to reset_peak_heap.
+ */
+std::atomic<std::size_t> current_heap(0);
+std::atomic<std::size_t> peak_heap(0);
+
+/**
+ * The header stored before every block allocated by the operators below.
+ */
+struct BlockHeader {
+  void *base;       // The pointer returned by malloc.
+  std::size_t size; // The size requested.
+};
+
+/**
+ * Allocate size bytes aligned on alignment, and count them.
+ */
+void *allocate(std::size_t size, std::size_t alignment) noexcept {
+  alignment = std::max(alignment, alignof(BlockHeader));
+  void *base = std::malloc(size + sizeof(BlockHeader) + alignment);
+  if (base == nullptr) {
+    return nullptr;
+  }
+  std::uintptr_t address =
+      reinterpret_cast<std::uintptr_t>(base) + sizeof(BlockHeader);
+  address = (address + alignment - 1) & ~std::uintptr_t(alignment - 1);
+  BlockHeader *header = reinterpret_cast<BlockHeader *>(address) - 1;
+  header->base = base;
+  header->size = size;
+
+  std::size_t current = current_heap.fetch_add(size) + size;
+  std::size_t peak = peak_heap.load();
+  while (peak < current && !peak_heap.compare_exchange_weak(peak, current)) {
+  }
+  return reinterpret_cast<void *>(address);
+}
+
+/**
+ * Free a block returned by allocate.
+ */
+void deallocate(void *p) noexcept {
+  if (p == nullptr) {
+    return;
+  }
+  // The header is found from the address, so the compiler does not see an
+  // access before the start of the object being deleted.
+  BlockHeader *header = reinterpret_cast<BlockHeader *>(
+      reinterpret_cast<std::uintptr_t>(p) - sizeof(BlockHeader));
+  current_heap.fetch_sub(header->size);
+  std::free(header->base);
+}
+
+/**
+ * Start measuring the peak of the heap from the current allocations.
+ */
+void reset_peak_heap() noexcept { peak_heap.store(current_heap.load()); }
+
+} // namespace
+
+// The other forms of new and delete call these ones by default.
+void *operator new(std::size_t size) {
+  void *p = allocate(size, alignof(std::max_align_t));
+  if (p == nullptr) {
+    throw std::bad_alloc();
+  }
+  return p;
+}
+
+void *operator new(std::size_t size, std::align_val_t alignment) {
+  void *p = allocate(size, static_cast<std::size_t>(alignment));
+  if (p == nullptr) {
+    throw std::bad_alloc();
+  }
+  return p;
+}
+
+// The sized and array forms of delete are replaced too, since the compiler may
+// call them directly.
+void operator delete(void *p) noexcept { deallocate(p); }
+
+void operator delete(void *p, std::size_t) noexcept { deallocate(p); }
+
+void operator delete(void *p, std::align_val_t) noexcept { deallocate(p); }
+
+void operator delete(void *p, std::size_t, std::align_val_t) noexcept {
+  deallocate(p);
+}
+
+void operator delete[](void *p) noexcept { deallocate(p); }
+
+void operator delete[](void *p, std::size_t) noexcept { deallocate(p); }
+
+void operator delete[](void *p, std::align_val_t) noexcept { deallocate(p); }
+
+void operator delete[](void *p, std::size_t, std::align_val_t) noexcept {
+  deallocate(p);
+}
+
+namespace {
+
+/**
+ * The seeds used for every instance, so that two commits do the same runs.
+ */
+constexpr int seeds[] = {0, 1, 2, 3, 4, 5, 6, 7, 8, 9};
+
+/**
+ * The number of runs done before the measures, and the number of times every
+ * seed is run during the measures.
+ */
+struct BenchmarkOptions {
+  unsigned nb_warmup = 1;      // Runs of the first seed, not measured.
+  unsigned nb_repetitions = 3; // Measured runs of every seed.
+  string output_path;          // The JSON file written, stdout if empty.
+};
+
+/**
+ * The measures of an instance.
+ */
+struct InstanceResult {
+  string name;
+  string type;               // overlapping or simpletiled.
+  vector<double> times;      // The time of every measured run, in seconds.
+  unsigned nb_successes = 0; // The number of measured runs that succeeded.
+  std::size_t peak_heap = 0; // The largest heap used by a run, in bytes.
+  string error;              // Why the instance was not run, if it failed.
+};
+
+/**
+ * Return the value at the percentile p (in [0, 1]) of sorted values, with the
+ * nearest rank method.
+ */
+double get_percentile(const vector<double> &sorted_values, double p) {
+  std::size_t rank =
+      static_cast<std::size_t>(std::ceil(p * sorted_values.size()));
+  return sorted_values[rank == 0 ? 0 : rank - 1];
+}
+
+/**
+ * Return the median of sorted values.
+ */
+double get_median(const vector<double> &sorted_values) {
+  std::size_t n = sorted_values.size();
+  if (n % 2 == 1) {
+    return sorted_values[n / 2];
+  }
+  return (sorted_values[n / 2 - 1] + sorted_values[n / 2]) / 2;
+}
+
+/**
+ * Run the wfc built by make(seed) with every seed, after the warmup, and
+ * measure the time spent to build and run it, and the heap it used.
+ */
+template <typename F>
+InstanceResult benchmark(const string &name, const string &type, F &&make,
+                         const BenchmarkOptions &options) {
+  for (unsigned i = 0; i < options.nb_warmup; i++) {
+    make(seeds[0]).run();
+  }
+
+  InstanceResult result = {name, type, {}, 0, 0};
+  for (unsigned repetition = 0; repetition < options.nb_repetitions;
+       repetition++) {
+    for (int seed : seeds) {
+      std::size_t heap_before = current_heap.load();
+      reset_peak_heap();
+      auto start = std::chrono::steady_clock::now();
+      bool success = make(seed).run().has_value();
+      auto end = std::chrono::steady_clock::now();
+      result.peak_heap =
+          std::max(result.peak_heap, peak_heap.load() - heap_before);
+      result.times.push_back(std::chrono::duration<double>(end - start).count());
+      if (success) {
+        result.nb_successes++;
+      }
+    }
+  }
+  return result;
+}
+
+/**
+ * Return the name of the instance described by node in the results.
+ */
+string get_instance_name(xml_node<> *node) {
+  string name = rapidxml::get_attribute(node, "name");
+  if (string(node->name()) == "overlapping") {
+    return name + " N=" + rapidxml::get_attribute(node, "N");
+  }
+  return name + " " + rapidxml::get_attribute(node, "subset", "tiles");
+}
+
+/**
+ * Benchmark an overlapping instance.
+ */
+InstanceResult benchmark_overlapping_instance(xml_node<> *node,
+                                              const BenchmarkOptions &options) {
+  string name = rapidxml::get_attribute(node, "name");
+  std::optional<Array2D<Color>> m = read_image("samples/" + name + ".png");
+  if (!m.has_value()) {
+    throw "Error while loading samples/" + name + ".png";
+  }
+  OverlappingWFCOptions wfc_options = read_overlapping_options(node);
+  return benchmark(
+      get_instance_name(node), "overlapping",
+      [&](int seed) { return OverlappingWFC<Color>(*m, wfc_options, seed); },
+      options);
+}
+
+/**
+ * Benchmark a tiling instance.
+ */
+InstanceResult benchmark_simpletiled_instance(xml_node<> *node,
+                                              const string &current_dir,
+                                              const BenchmarkOptions &options) {
+  string name = rapidxml::get_attribute(node, "name");
+  string subset = rapidxml::get_attribute(node, "subset", "tiles");
+  bool periodic_output =
+      (rapidxml::get_attribute(node, "periodic", "False") == "True");
+  unsigned width = stoi(rapidxml::get_attribute(node, "width", "48"));
+  unsigned height = stoi(rapidxml::get_attribute(node, "height", "48"));
+  TilingProblem problem = read_tiling_problem(current_dir, name, subset);
+  TilingWFCOptions wfc_options = {periodic_output};
+  return benchmark(
+      get_instance_name(node), "simpletiled",
+      [&](int seed) {
+        return TilingWFC<Color>(problem.tiles, problem.neighbors, height,
+                                width, wfc_options, seed);
+      },
+      options);
+}
+
+/**
+ * Return s as a JSON string.
+ */
+string to_json_string(const string &s) {
+  string result = "\"";
+  for (char c : s) {
+    if (c == '"' || c == '\\') {
+      result += '\\';
+    }
+    result += c;
+  }
+  return result + "\"";
+}
+
+/**
+ * Write the results as a JSON document.
+ */
+void write_json(FILE *file, const vector<InstanceResult> &results,
+                const BenchmarkOptions &options) {
+  fprintf(file, "{\n");
+  fprintf(file, "  \"warmup\": %u,\n", options.nb_warmup);
+  fprintf(file, "  \"repetitions\": %u,\n", options.nb_repetitions);
+  fprintf(file, "  \"seeds\": [");
+  for (std::size_t i = 0; i < std::size(seeds); i++) {
+    fprintf(file, "%s%d", i == 0 ? "" : ", ", seeds[i]);
+  }
+  fprintf(file, "],\n");
+  fprintf(file, "  \"instances\": [\n");
+  for (std::size_t i = 0; i < results.size(); i++) {
+    const InstanceResult &result = results[i];
+    fprintf(file, "    {\"index\": %zu, \"name\": %s, \"type\": \"%s\", ", i,
+            to_json_string(result.name).c_str(), result.type.c_str());
+    if (!result.error.empty()) {
+      fprintf(file, "\"error\": %s}%s\n", to_json_string(result.error).c_str(),
+              i + 1 == results.size() ? "" : ",");
+      continue;
+    }
+    vector<double> times = result.times;
+    std::sort(times.begin(), times.end());
+    fprintf(file, "\"runs\": %zu, \"success_rate\": %.4f, ", times.size(),
+            double(result.nb_successes) / times.size());
+    fprintf(file, "\"median_ms\": %.3f, \"p95_ms\": %.3f, ",
+            get_median(times) * 1000, get_percentile(times, 0.95) * 1000);
+    fprintf(file, "\"peak_heap_bytes\": %zu}%s\n", result.peak_heap,
+            i + 1 == results.size() ? "" : ",");
+  }
+  fprintf(file, "  ]\n");
+  fprintf(file, "}\n");
+}
+
+/**
+ * Read the options given on the command line.
+ */
+BenchmarkOptions read_options(int argc, char **argv) {
+  BenchmarkOptions options;
+  for (int i = 1; i < argc; i++) {
+    string arg = argv[i];
+    if (i + 1 == argc) {
+      throw "Missing value after " + arg;
+    }
+    if (arg == "--warmup") {
+      options.nb_warmup = std::max(0, stoi(argv[++i]));
+    } else if (arg == "--repetitions") {
+      options.nb_repetitions = std::max(1, stoi(argv[++i]));
+    } else if (arg == "--output") {
+      options.output_path = argv[++i];
+    } else {
+      throw "Unknown option " + arg;
+    }
+  }
+  return options;
+}
+
+} // namespace
+
+/**
+ * Run every instance of samples.xml with fixed seeds, and write the median and
+ * 95th percentile of the time of a run (building the model included), the
+ * success rate and the peak heap usage of every instance as JSON.
+ * Usage: wfc_benchmark [--warmup N] [--repetitions N] [--output file.json]
+ */
+int main(int argc, char **argv) {
+  BenchmarkOptions options;
+  try {
+    options = read_options(argc, argv);
+  } catch (const string &error) {
+    cerr << error << endl;
+    return 1;
+  }
+
+  const string config_path = "samples.xml";
+  ifstream config_file(config_path);
+  vector<char> buffer((istreambuf_iterator<char>(config_file)),
+                      istreambuf_iterator<char>());
+  buffer.push_back('\0');
+  xml_document<> document;
+  document.parse<0>(&buffer[0]);
+
+  vector<InstanceResult> results;
+  xml_node<> *root_node = document.first_node("samples");
+  string dir_path = get_dir(config_path) + "/" + "samples";
+  // An instance that cannot be read is recorded with its error, and the
+  // other instances are still run.
+  auto add_result = [&](xml_node<> *node, const string &type, auto &&run) {
+    string error;
+    try {
+      results.push_back(run());
+      cerr << results.back().name << " done" << endl;
+      return;
+    } catch (const string &e) {
+      error = e;
+    } catch (const std::exception &e) {
+      // A malformed tile set, or an attribute that is not a number.
+      error = e.what();
+    }
+    InstanceResult result;
+    result.name = get_instance_name(node);
+    result.type = type;
+    result.error = error;
+    results.push_back(result);
+    cerr << result.name << " failed: " << error << endl;
+  };
+  for (xml_node<> *node = root_node->first_node("overlapping"); node;
+       node = node->next_sibling("overlapping")) {
+    add_result(node, "overlapping", [&]() {
+      return benchmark_overlapping_instance(node, options);
+    });
+  }
+  for (xml_node<> *node = root_node->first_node("simpletiled"); node;
+       node = node->next_sibling("simpletiled")) {
+    add_result(node, "simpletiled", [&]() {
+      return benchmark_simpletiled_instance(node, dir_path, options);
+    });
+  }
+
+  FILE *file = options.output_path.empty()
+                   ? stdout
+                   : fopen(options.output_path.c_str(), "w");
+  if (file == nullptr) {
+    cerr << "Cannot open " << options.output_path << endl;
+    return 1;
+  }
+  write_json(file, results, options);
+  if (file != stdout) {
+    fclose(file);
+  }
+  return 0;
+}
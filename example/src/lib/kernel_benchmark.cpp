@@ -0,0 +1,294 @@
+#include <algorithm>
+#include <chrono>
+#include <cstdio>
+#include <memory>
+#include <random>
+#include <string>
+#include <utility>
+#include <vector>
+
+#include "fastwfc/direction.hpp"
+#include "fastwfc/model.hpp"
+#include "fastwfc/propagator.hpp"
+#include "fastwfc/wave.hpp"
+
+using namespace std;
+
+namespace {
+
+/**
+ * The numbers of patterns and the sizes of the (square) waves of the grid.
+ */
+constexpr unsigned patterns_counts[] = {16, 64, 256, 1024};
+constexpr unsigned wave_sizes[] = {32, 64, 128};
+
+/**
+ * The largest number of compatibility counts of a propagator in the grid.
+ * The bigger configurations are skipped.
+ */
+constexpr std::size_t max_nb_counts = std::size_t(1) << 25;
+
+/**
+ * The number of removals timed for Wave::set, the number of calls timed for
+ * Wave::get_min_entropy and the cells changed before each of them, and the
+ * number of removals drawn for Propagator::propagate.
+ */
+constexpr std::size_t nb_set_removals = 1 << 18;
+constexpr unsigned nb_min_entropy_calls = 256;
+constexpr unsigned nb_changes_per_call = 8;
+constexpr unsigned nb_propagate_calls = 2048;
+
+/**
+ * The kinds of synthetic rules.
+ */
+enum class Rules {
+  sparse, // Every pattern is compatible with a few random patterns.
+  dense,  // Every pair of patterns is compatible with probability 1/2.
+  banded, // Two patterns are compatible if their ids are close.
+};
+
+const char *get_name(Rules rules) {
+  switch (rules) {
+  case Rules::sparse:
+    return "sparse";
+  case Rules::dense:
+    return "dense";
+  default:
+    return "banded";
+  }
+}
+
+/**
+ * Return the synthetic rules of the given kind for nb_patterns patterns.
+ * The rules are symmetric: pattern2 is compatible with pattern1 in a direction
+ * if and only if pattern1 is compatible with pattern2 in the opposite one.
+ */
+Model::PropagatorState make_rules(Rules rules, unsigned nb_patterns,
+                                  std::minstd_rand &gen) {
+  // The pairs compatible in the directions 0 and 1, the directions 3 and 2
+  // being their opposites.
+  vector<vector<uint8_t>> compatible[2];
+  for (auto &matrix : compatible) {
+    matrix = vector<vector<uint8_t>>(nb_patterns,
+                                     vector<uint8_t>(nb_patterns, 0));
+    for (unsigned pattern1 = 0; pattern1 < nb_patterns; pattern1++) {
+      if (rules == Rules::sparse) {
+        std::uniform_int_distribution<unsigned> dis(0, nb_patterns - 1);
+        for (unsigned k = 0; k < 4; k++) {
+          matrix[pattern1][dis(gen)] = 1;
+        }
+        continue;
+      }
+      for (unsigned pattern2 = 0; pattern2 < nb_patterns; pattern2++) {
+        if (rules == Rules::dense) {
+          matrix[pattern1][pattern2] = gen() % 2;
+        } else {
+          unsigned distance = pattern1 > pattern2 ? pattern1 - pattern2
+                                                  : pattern2 - pattern1;
+          matrix[pattern1][pattern2] = distance <= 2;
+        }
+      }
+    }
+  }
+
+  Model::PropagatorState state(nb_patterns);
+  for (unsigned pattern1 = 0; pattern1 < nb_patterns; pattern1++) {
+    for (unsigned pattern2 = 0; pattern2 < nb_patterns; pattern2++) {
+      for (unsigned direction = 0; direction < 2; direction++) {
+        if (compatible[direction][pattern1][pattern2]) {
+          state[pattern1][direction].push_back(pattern2);
+          state[pattern2][get_opposite_direction(direction)].push_back(
+              pattern1);
+        }
+      }
+    }
+  }
+  for (auto &patterns : state) {
+    for (vector<unsigned> &support : patterns) {
+      std::sort(support.begin(), support.end());
+    }
+  }
+  return state;
+}
+
+/**
+ * Return random distinct (cell, pattern) pairs, in a random order, that can
+ * all be removed from a wave without emptying a cell: the pattern 0 is never
+ * in them.
+ */
+vector<pair<unsigned, unsigned>> make_removals(unsigned nb_cells,
+                                               unsigned nb_patterns,
+                                               std::size_t nb_removals,
+                                               std::minstd_rand &gen) {
+  std::size_t nb_pairs = std::size_t(nb_cells) * (nb_patterns - 1);
+  nb_removals = std::min(nb_removals, nb_pairs / 2);
+  vector<pair<unsigned, unsigned>> removals;
+  std::uniform_int_distribution<std::size_t> dis(0, nb_pairs - 1);
+  while (removals.size() < nb_removals) {
+    std::size_t pair = dis(gen);
+    removals.emplace_back(pair / (nb_patterns - 1),
+                          1 + pair % (nb_patterns - 1));
+    if (removals.size() == nb_removals) {
+      std::sort(removals.begin(), removals.end());
+      removals.erase(std::unique(removals.begin(), removals.end()),
+                     removals.end());
+    }
+  }
+  std::shuffle(removals.begin(), removals.end(), gen);
+  return removals;
+}
+
+/**
+ * Return the time in nanoseconds spent in f.
+ */
+template <typename F> double time_ns(F &&f) {
+  auto start = std::chrono::steady_clock::now();
+  f();
+  auto end = std::chrono::steady_clock::now();
+  return std::chrono::duration<double, std::nano>(end - start).count();
+}
+
+/**
+ * Return the time of Wave::set(cell, pattern, false), per removal.
+ */
+double benchmark_set(const shared_ptr<const Model> &model, unsigned size,
+                     std::minstd_rand &gen) {
+  Wave wave(size, size, model);
+  auto removals =
+      make_removals(wave.size, model->nb_patterns, nb_set_removals, gen);
+  double time = time_ns([&]() {
+    for (auto [cell, pattern] : removals) {
+      wave.set(cell, pattern, false);
+    }
+  });
+  return time / removals.size();
+}
+
+/**
+ * Return the time of Wave::get_min_entropy, per call, when a few cells
+ * changed since the previous call.
+ */
+double benchmark_min_entropy(const shared_ptr<const Model> &model,
+                             unsigned size, MinEntropySearch search,
+                             std::minstd_rand &gen) {
+  Wave wave(size, size, model, search);
+  auto removals = make_removals(wave.size, model->nb_patterns,
+                                nb_min_entropy_calls * nb_changes_per_call,
+                                gen);
+  wave.get_min_entropy(gen);
+
+  double time = 0;
+  unsigned nb_calls = 0;
+  for (std::size_t i = 0; i + nb_changes_per_call <= removals.size();
+       i += nb_changes_per_call) {
+    for (std::size_t j = i; j < i + nb_changes_per_call; j++) {
+      wave.set(removals[j].first, removals[j].second, false);
+    }
+    time += time_ns([&]() { wave.get_min_entropy(gen); });
+    nb_calls++;
+  }
+  return time / nb_calls;
+}
+
+/**
+ * Return the time spent building a propagator with engine, which allocates
+ * and initializes the compatibility counts with the counters engine.
+ */
+double benchmark_init(const shared_ptr<const Model> &model, unsigned size,
+                      PropagationEngine engine) {
+  return time_ns([&]() {
+    Propagator propagator(size, size, false, model,
+                          CompatibleLayout::direction_major, engine);
+  });
+}
+
+/**
+ * Return the time of Propagator::propagate with engine, per call, after the
+ * removal of a random pattern from a random cell. The wave is reset when it
+ * is in contradiction. The removals only depend on gen, so both engines
+ * propagate the same removals.
+ */
+double benchmark_propagate(const shared_ptr<const Model> &model,
+                           unsigned size, PropagationEngine engine,
+                           std::minstd_rand gen) {
+  Wave wave(size, size, model);
+  Propagator propagator(size, size, false, model,
+                        CompatibleLayout::direction_major, engine);
+  const Wave initial_wave = wave;
+  const Propagator initial_propagator = propagator;
+
+  std::uniform_int_distribution<unsigned> cell_dis(0, wave.size - 1);
+  std::uniform_int_distribution<unsigned> pattern_dis(0,
+                                                      model->nb_patterns - 1);
+  // The draws of patterns that are already removed, or of the last pattern of
+  // a cell, are skipped, so only the calls actually timed are counted.
+  double time = 0;
+  unsigned nb_timed_calls = 0;
+  for (unsigned call = 0; call < nb_propagate_calls; call++) {
+    unsigned cell = cell_dis(gen);
+    unsigned pattern = pattern_dis(gen);
+    if (!wave.get(cell, pattern) || wave.count(cell) == 1) {
+      continue;
+    }
+    wave.set(cell, pattern, false);
+    propagator.add_to_propagator(cell / size, cell % size, pattern);
+    time += time_ns([&]() { propagator.propagate(wave); });
+    nb_timed_calls++;
+    if (wave.is_impossible()) {
+      wave.copy_state(initial_wave);
+      propagator.copy_state(initial_propagator);
+    }
+  }
+  return nb_timed_calls == 0 ? 0 : time / nb_timed_calls;
+}
+
+} // namespace
+
+/**
+ * Time the core kernels in isolation, on synthetic rules, for a grid of
+ * numbers of patterns and wave sizes:
+ * - set: Wave::set removing a pattern, in ns per removal.
+ * - heap, scan: Wave::get_min_entropy with the indexed heap and the linear
+ *   scan, after 8 cells changed, in ns per call.
+ * - init: building a Propagator with the counters engine, which initializes
+ *   the compatibility counts, in us.
+ * - counters, bitsets: Propagator::propagate after the removal of a random
+ *   pattern, cascade included, in ns per call.
+ */
+int main() {
+  printf("%-7s %8s %5s %8s %9s %9s %11s %10s %10s %9s\n", "rules", "patterns",
+         "size", "density", "set", "heap", "scan", "init", "counters",
+         "bitsets");
+  for (Rules rules : {Rules::sparse, Rules::dense, Rules::banded}) {
+    for (unsigned nb_patterns : patterns_counts) {
+      std::minstd_rand gen(nb_patterns);
+      vector<double> frequencies(nb_patterns);
+      std::uniform_real_distribution<> frequency_dis(0.5, 1.5);
+      for (double &frequency : frequencies) {
+        frequency = frequency_dis(gen);
+      }
+      auto model = make_shared<const Model>(
+          frequencies, make_rules(rules, nb_patterns, gen));
+
+      for (unsigned size : wave_sizes) {
+        if (std::size_t(size) * size * nb_patterns * 4 > max_nb_counts) {
+          continue;
+        }
+        double set = benchmark_set(model, size, gen);
+        double heap = benchmark_min_entropy(model, size,
+                                            MinEntropySearch::indexed_heap, gen);
+        double scan = benchmark_min_entropy(model, size,
+                                            MinEntropySearch::linear_scan, gen);
+        double init = benchmark_init(model, size, PropagationEngine::counters);
+        double counters =
+            benchmark_propagate(model, size, PropagationEngine::counters, gen);
+        double bitsets =
+            benchmark_propagate(model, size, PropagationEngine::bitsets, gen);
+        printf("%-7s %8u %5u %8.3f %9.1f %9.1f %11.1f %10.1f %10.1f %9.1f\n",
+               get_name(rules), nb_patterns, size, model->density, set, heap,
+               scan, init / 1000, counters, bitsets);
+        fflush(stdout);
+      }
+    }
+  }
+}
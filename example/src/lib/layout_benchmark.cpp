@@ -0,0 +1,143 @@
+#include <chrono>
+#include <cstdio>
+#include <fstream>
+#include <iostream>
+#include <string>
+#include <vector>
+
+#include "fastwfc/overlapping_wfc.hpp"
+#include "fastwfc/tiling_wfc.hpp"
+#include "external/rapidxml.hpp"
+#include "rapidxml_utils.hpp"
+#include "samples.hpp"
+#include "utils.hpp"
+
+using namespace rapidxml;
+using namespace std;
+
+namespace {
+
+/**
+ * The number of seeds used for every instance.
+ */
+constexpr unsigned nb_seeds = 10;
+
+/**
+ * The layouts compared.
+ */
+constexpr CompatibleLayout layouts[2] = {CompatibleLayout::pattern_major,
+                                         CompatibleLayout::direction_major};
+
+/**
+ * Return the time in seconds spent to build and run the wfc built by make.
+ */
+template <typename F> double time_run(F &&make, unsigned &nb_successes) {
+  auto start = std::chrono::steady_clock::now();
+  auto wfc = make();
+  if (wfc.run().has_value()) {
+    nb_successes++;
+  }
+  auto end = std::chrono::steady_clock::now();
+  return std::chrono::duration<double>(end - start).count();
+}
+
+/**
+ * Print the result of an instance.
+ */
+void print_result(const string &name, const double (&times)[2],
+                  const unsigned (&successes)[2]) {
+  printf("%-40s %14.3f %16.3f %8.2fx %5u/%u\n", name.c_str(), times[0] * 1000,
+         times[1] * 1000, times[0] / times[1], successes[1], nb_seeds);
+  if (successes[0] != successes[1]) {
+    printf("  warning: the layouts have different results\n");
+  }
+}
+
+/**
+ * Benchmark an overlapping instance.
+ */
+void benchmark_overlapping_instance(xml_node<> *node) {
+  string name = rapidxml::get_attribute(node, "name");
+  string N = rapidxml::get_attribute(node, "N");
+  std::optional<Array2D<Color>> m = read_image("samples/" + name + ".png");
+  if (!m.has_value()) {
+    throw "Error while loading samples/" + name + ".png";
+  }
+  OverlappingWFCOptions options = read_overlapping_options(node);
+  // The layouts only matter to the counters engine.
+  options.wfc_options.propagation_engine = PropagationEngine::counters;
+
+  double times[2] = {0, 0};
+  unsigned successes[2] = {0, 0};
+  for (unsigned seed = 0; seed < nb_seeds; seed++) {
+    for (unsigned l = 0; l < 2; l++) {
+      options.wfc_options.compatible_layout = layouts[l];
+      times[l] += time_run(
+          [&]() { return OverlappingWFC<Color>(*m, options, seed); },
+          successes[l]);
+    }
+  }
+  print_result(name + " N=" + N, times, successes);
+}
+
+/**
+ * Benchmark a tiling instance.
+ */
+void benchmark_simpletiled_instance(xml_node<> *node,
+                                    const string &current_dir) {
+  string name = rapidxml::get_attribute(node, "name");
+  string subset = rapidxml::get_attribute(node, "subset", "tiles");
+  bool periodic_output =
+      (rapidxml::get_attribute(node, "periodic", "False") == "True");
+  unsigned width = stoi(rapidxml::get_attribute(node, "width", "48"));
+  unsigned height = stoi(rapidxml::get_attribute(node, "height", "48"));
+  TilingProblem problem = read_tiling_problem(current_dir, name, subset);
+  TilingWFCOptions options = {periodic_output};
+  options.wfc_options.propagation_engine = PropagationEngine::counters;
+
+  double times[2] = {0, 0};
+  unsigned successes[2] = {0, 0};
+  for (unsigned seed = 0; seed < nb_seeds; seed++) {
+    for (unsigned l = 0; l < 2; l++) {
+      options.wfc_options.compatible_layout = layouts[l];
+      times[l] += time_run(
+          [&]() {
+            return TilingWFC<Color>(problem.tiles, problem.neighbors, height,
+                                    width, options, seed);
+          },
+          successes[l]);
+    }
+  }
+  print_result(name + " " + subset, times, successes);
+}
+
+} // namespace
+
+/**
+ * Compare the two layouts of the propagator compatibility counts on the
+ * samples of samples.xml.
+ * Every instance is run with the same seeds for both layouts. Since the
+ * layouts do not change the result, both layouts do exactly the same work.
+ */
+int main() {
+  const string config_path = "samples.xml";
+  ifstream config_file(config_path);
+  vector<char> buffer((istreambuf_iterator<char>(config_file)),
+                      istreambuf_iterator<char>());
+  buffer.push_back('\0');
+  xml_document<> document;
+  document.parse<0>(&buffer[0]);
+
+  printf("%-40s %14s %16s %9s %9s\n", "instance", "pattern_major",
+         "direction_major", "speedup", "success");
+  xml_node<> *root_node = document.first_node("samples");
+  string dir_path = get_dir(config_path) + "/" + "samples";
+  for (xml_node<> *node = root_node->first_node("overlapping"); node;
+       node = node->next_sibling("overlapping")) {
+    benchmark_overlapping_instance(node);
+  }
+  for (xml_node<> *node = root_node->first_node("simpletiled"); node;
+       node = node->next_sibling("simpletiled")) {
+    benchmark_simpletiled_instance(node, dir_path);
+  }
+}
@@ -0,0 +1,113 @@
+#ifndef FAST_WFC_BLOCK_WFC_HPP_
+#define FAST_WFC_BLOCK_WFC_HPP_
+
+#include <memory>
+#include <optional>
+#include <vector>
+
+#include "utils/array2D.hpp"
+#include "model.hpp"
+#include "wfc.hpp"
+
+/**
+ * Options needed to use the block wfc.
+ */
+struct BlockWFCOptions {
+  unsigned block_size = 64; // The width and height of a block, in cells.
+  unsigned overlap = 8; // The number of cells of the neighbor blocks solved
+                        // again with a block. At most (block_size - 1) / 2.
+  unsigned nb_threads = 0;  // The number of threads, 0 meaning one per core.
+  unsigned nb_attempts = 10; // The number of seeds tried to solve a block.
+  WFCOptions wfc_options = {}; // The options of the underlying generic wfc.
+};
+
+/**
+ * Class solving a large output by blocks, on several threads.
+ * The output is split in blocks of block_size * block_size cells. A block is
+ * solved in a small wave containing the block, overlap cells of its
+ * neighbors, and a ring of one cell around them. The decided cells of the
+ * ring are fixed, so the block matches the cells around it, and the overlap
+ * cells are solved again, which leaves room to fix the seams.
+ * The blocks are solved in 4 phases, following the parity of their
+ * coordinates. Two blocks of the same phase are separated by at least a
+ * block, so they are solved concurrently without sharing any cell, and the
+ * result only depends on the seed.
+ * A block that leads to a contradiction is solved again with another seed,
+ * without changing the other blocks.
+ * The output is never toric.
+ */
+class BlockWFC {
+private:
+  /**
+   * The patterns and the rules.
+   */
+  std::shared_ptr<const Model> model;
+
+  /**
+   * Options needed by the algorithm.
+   */
+  BlockWFCOptions options;
+
+  /**
+   * The seed of the output. The seeds of the blocks are derived from it.
+   */
+  const int seed;
+
+  /**
+   * The pattern of every decided cell of the output.
+   * is_decided[cell] is true if the cell has a pattern, and is_fixed[cell] is
+   * true if it was set with set_pattern, in which case it is never changed.
+   */
+  Array2D<unsigned> output;
+  std::vector<uint8_t> is_decided;
+  std::vector<uint8_t> is_fixed;
+
+  /**
+   * The patterns that can only be placed in the fixed cells.
+   */
+  std::vector<unsigned> banned_patterns;
+
+  /**
+   * Return the seed used for the given attempt to solve the block (block_y,
+   * block_x).
+   */
+  int get_block_seed(unsigned block_y, unsigned block_x,
+                     unsigned attempt) const noexcept;
+
+  /**
+   * Solve the block (block_y, block_x) and its overlap, and write them in
+   * output. Return false if every attempt led to a contradiction.
+   */
+  bool solve_block(unsigned block_y, unsigned block_x) noexcept;
+
+public:
+  /**
+   * Build a solver for an output of height * width cells, with the patterns
+   * and rules of model.
+   */
+  BlockWFC(std::shared_ptr<const Model> model, unsigned height, unsigned width,
+           const BlockWFCOptions &options, int seed) noexcept;
+
+  /**
+   * Place pattern in the cell (i, j) of the output.
+   */
+  void set_pattern(unsigned i, unsigned j, unsigned pattern) noexcept {
+    output.get(i, j) = pattern;
+    is_decided[i * output.width + j] = 1;
+    is_fixed[i * output.width + j] = 1;
+  }
+
+  /**
+   * Forbid pattern in every cell that was not set with set_pattern.
+   */
+  void ban_pattern(unsigned pattern) noexcept {
+    banned_patterns.push_back(pattern);
+  }
+
+  /**
+   * Solve every block, and return the output if every block succeeded.
+   */
+  std::optional<Array2D<unsigned>> run() noexcept;
+};
+
+#endif // FAST_WFC_BLOCK_WFC_HPP_
@@ -0,0 +1,119 @@
+#ifndef FAST_WFC_CHUNKED_WFC_HPP_
+#define FAST_WFC_CHUNKED_WFC_HPP_
+
+#include <map>
+#include <memory>
+#include <optional>
+#include <utility>
+#include <vector>
+
+#include "utils/array2D.hpp"
+#include "model.hpp"
+#include "wfc.hpp"
+
+/**
+ * Options needed to use the chunked wfc.
+ */
+struct ChunkedWFCOptions {
+  unsigned chunk_height;     // The number of cells of a chunk vertically.
+  unsigned chunk_width;      // The number of cells of a chunk horizontally.
+  unsigned nb_attempts = 10; // The number of seeds tried to solve a chunk.
+  WFCOptions wfc_options = {}; // The options of the underlying generic wfc.
+};
+
+/**
+ * Class generating an unbounded world chunk by chunk, on demand.
+ * A chunk is solved with the borders of its already generated neighbors as
+ * constraints, so the chunks match wherever they are generated from.
+ * Only the border rows and columns of the generated chunks are kept, and the
+ * chunks themselves are returned to the caller, so the memory used does not
+ * depend on the size of the world. The borders of a chunk that will not get
+ * new neighbors can be evicted.
+ * The borders of several neighbors may not be compatible with each other. If
+ * a chunk cannot be solved, a neighbor can be evicted (and generated again
+ * later) before trying again.
+ */
+class ChunkedWFC {
+private:
+  /**
+   * The patterns on the borders of a generated chunk.
+   */
+  struct Borders {
+    std::vector<unsigned> top;    // The first row.
+    std::vector<unsigned> bottom; // The last row.
+    std::vector<unsigned> left;   // The first column.
+    std::vector<unsigned> right;  // The last column.
+  };
+
+  /**
+   * Options needed by the algorithm.
+   */
+  const ChunkedWFCOptions options;
+
+  /**
+   * The seed of the world. The seeds of the chunks are derived from it.
+   */
+  const int seed;
+
+  /**
+   * The wfc solving a chunk with a margin of one cell on every side, where
+   * the borders of the neighbors are placed.
+   */
+  WFC wfc;
+
+  /**
+   * The state of wfc before any constraint, restored for every chunk.
+   */
+  const WFC::Snapshot initial_state;
+
+  /**
+   * The borders of the generated chunks, by (chunk_y, chunk_x).
+   */
+  std::map<std::pair<int, int>, Borders> borders;
+
+  /**
+   * Return the borders of the chunk (chunk_y, chunk_x), or nullptr if it is
+   * not generated.
+   */
+  const Borders *get_borders(int chunk_y, int chunk_x) const noexcept;
+
+  /**
+   * Return the seed used for the given attempt to solve the chunk (chunk_y,
+   * chunk_x).
+   */
+  int get_chunk_seed(int chunk_y, int chunk_x, unsigned attempt) const
+      noexcept;
+
+public:
+  /**
+   * Build a generator of chunks with the patterns and rules of model.
+   */
+  ChunkedWFC(std::shared_ptr<const Model> model,
+             const ChunkedWFCOptions &options, int seed) noexcept;
+
+  /**
+   * Generate the chunk (chunk_y, chunk_x), whose cell (i, j) is the cell
+   * (chunk_y * chunk_height + i, chunk_x * chunk_width + j) of the world.
+   * Return the patterns of the chunk if it could be solved with the borders
+   * of its generated neighbors, and keep its own borders for its neighbors.
+   * Generating a chunk that was already generated replaces its borders.
+   */
+  std::optional<Array2D<unsigned>> generate(int chunk_y, int chunk_x) noexcept;
+
+  /**
+   * Return true if the borders of the chunk (chunk_y, chunk_x) are kept.
+   */
+  bool is_generated(int chunk_y, int chunk_x) const noexcept {
+    return get_borders(chunk_y, chunk_x) != nullptr;
+  }
+
+  /**
+   * Forget the borders of the chunk (chunk_y, chunk_x). The chunks generated
+   * next to it afterwards will not have to match it.
+   */
+  void evict(int chunk_y, int chunk_x) noexcept {
+    borders.erase({chunk_y, chunk_x});
+  }
+};
+
+#endif // FAST_WFC_CHUNKED_WFC_HPP_
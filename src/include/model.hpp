@@ -0,0 +1,144 @@
+#ifndef FAST_WFC_MODEL_HPP_
+#define FAST_WFC_MODEL_HPP_
+
+#include "utils/aligned_allocator.hpp"
+#include <array>
+#include <cstdint>
+#include <mutex>
+#include <variant>
+#include <vector>
+
+/**
+ * The lists of a propagator state, stored contiguously in a compressed sparse
+ * row table.
+ * The patterns that can be placed next to pattern in the direction direction
+ * are stored in indices, from offsets[pattern * 4 + direction] included to
+ * offsets[pattern * 4 + direction + 1] excluded.
+ */
+template <typename Index> struct AdjacencyTable {
+  std::vector<std::size_t> offsets;
+  std::vector<Index> indices;
+
+  /**
+   * Return a pointer to the first pattern compatible with pattern in the
+   * direction direction.
+   */
+  const Index *begin(unsigned pattern, unsigned direction) const noexcept {
+    return indices.data() + offsets[pattern * 4 + direction];
+  }
+
+  /**
+   * Return a pointer after the last pattern compatible with pattern in the
+   * direction direction.
+   */
+  const Index *end(unsigned pattern, unsigned direction) const noexcept {
+    return indices.data() + offsets[pattern * 4 + direction + 1];
+  }
+
+  /**
+   * Return the number of patterns compatible with pattern in the direction
+   * direction.
+   */
+  std::size_t size(unsigned pattern, unsigned direction) const noexcept {
+    return offsets[pattern * 4 + direction + 1] -
+           offsets[pattern * 4 + direction];
+  }
+};
+
+/**
+ * The data of a WFC problem that does not depend on the output: the patterns
+ * frequencies and the rules saying which patterns can be placed next to each
+ * other.
+ * A model is never modified after its construction, so it can be shared by
+ * any number of WFC instances, running on any number of threads. The WFC
+ * instances only allocate the state of their own run.
+ */
+class Model {
+public:
+  /**
+   * propagator_state[pattern1][direction] contains all the patterns that can
+   * be placed in next to pattern1 in the direction direction.
+   */
+  using PropagatorState = std::vector<std::array<std::vector<unsigned>, 4>>;
+
+  /**
+   * The number of distinct patterns.
+   */
+  const std::size_t nb_patterns;
+
+  /**
+   * The patterns frequencies, normalized so their sum is 1.
+   */
+  const std::vector<double> patterns_frequencies;
+
+  /**
+   * The precomputation of p * log(p).
+   */
+  const std::vector<double> plogp_patterns_frequencies;
+
+  /**
+   * The precomputation of min (p * log(p)) / 2.
+   * This is used to define the maximum value of the noise.
+   */
+  const double min_abs_half_plogp;
+
+  /**
+   * True if all the patterns have the same frequency. The entropy of a cell is
+   * then the log of its number of patterns.
+   */
+  const bool uniform_frequencies;
+
+  /**
+   * log_counts[n] is log(n), for n in [1, nb_patterns]. It is only computed if
+   * uniform_frequencies is true, so the entropy never calls log(), and is
+   * empty otherwise.
+   */
+  const std::vector<double> log_counts;
+
+  /**
+   * The propagator state compiled in a single table, with the smallest index
+   * type that can contain every pattern.
+   */
+  const std::variant<AdjacencyTable<uint8_t>, AdjacencyTable<uint16_t>,
+                     AdjacencyTable<uint32_t>>
+      adjacency;
+
+  /**
+   * The size of the biggest list of the propagator state.
+   */
+  const std::size_t max_support;
+
+  /**
+   * The proportion of (pattern1, direction, pattern2) that are compatible.
+   */
+  const double density;
+
+  /**
+   * The number of 64-bit words of the bitset of a set of patterns.
+   */
+  const unsigned nb_words;
+
+  /**
+   * Build the model. The frequencies do not need to be normalized.
+   */
+  Model(std::vector<double> patterns_frequencies,
+        const PropagatorState &propagator_state) noexcept;
+
+  /**
+   * Return the bitsets of the patterns that can be placed next to each
+   * pattern in each direction. The bitset of (pattern, direction) is stored in
+   * the nb_words words starting at (pattern * 4 + direction) * nb_words.
+   * They are only used by the bitsets engine, so they are computed on the
+   * first call.
+   */
+  const uint64_t *get_masks() const noexcept;
+
+private:
+  /**
+   * The masks returned by get_masks, and the flag used to compute them once.
+   */
+  mutable std::vector<uint64_t, AlignedAllocator<uint64_t, 64>> masks;
+  mutable std::once_flag masks_flag;
+};
+
+#endif // FAST_WFC_MODEL_HPP_
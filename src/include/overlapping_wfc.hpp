@@ -3,9 +3,17 @@
 
 #include <vector>
 #include <algorithm>
+#include <cstdint>
+#include <limits>
+#include <memory>
+#include <optional>
 #include <unordered_map>
 
 #include "utils/array2D.hpp"
+#include "utils/parallel.hpp"
+#include "utils/pattern_arena.hpp"
+#include "block_wfc.hpp"
+#include "pattern_extraction.hpp"
 #include "wfc.hpp"
 
 /**
@@ -19,6 +27,8 @@ struct OverlappingWFCOptions {
   unsigned symmetry; // The number of symmetries (the order is defined in wfc).
   bool ground;       // True if the ground needs to be set (see init_ground).
   unsigned pattern_size; // The width and height in pixel of the patterns.
+  WFCOptions wfc_options = {}; // The options of the underlying generic wfc.
+  unsigned nb_model_threads = 0; // Threads building the model, 0 for all.
 
   /**
    * Get the wave height given these options.
@@ -36,261 +46,346 @@ struct OverlappingWFCOptions {
 };
 
 /**
- * Class generating a new image with the overlapping WFC algorithm.
+ * The model of an overlapping WFC problem: the patterns extracted from an
+ * input image, and the compiled rules saying which patterns overlap.
+ * It only depends on the input and on the periodic_input, symmetry, ground and
+ * pattern_size options, so it can be shared by every OverlappingWFC built from
+ * the same input with these options, on any number of threads.
  */
-template <typename T> class OverlappingWFC {
-
+template <typename T> class OverlappingModel {
 private:
   /**
-   * The input image. T is usually a color.
+   * Everything the model needs from an input.
    */
-  Array2D<T> input;
+  struct CompiledInput {
+    std::vector<T> palette;            // The distinct pixels of the input.
+    PatternArena<T> patterns;          // The distinct patterns.
+    std::vector<double> weights;       // The number of times they are seen.
+    Model::PropagatorState compatible; // See generate_compatible.
+    std::optional<unsigned> ground_pattern_id; // See ground_pattern_id.
+    WFCStats stats; // The time spent extracting the patterns and the rules.
+
+    /**
+     * Start with no pattern of size pattern_size * pattern_size.
+     */
+    explicit CompiledInput(unsigned pattern_size) noexcept
+        : patterns(pattern_size) {}
+  };
 
   /**
-   * Options needed by the algorithm.
+   * Replace every pixel of input by its index in a palette of the distinct
+   * pixels, and extract the patterns and the rules from the indices, stored
+   * in the smallest type that can hold them. The pixels are only compared
+   * and hashed once, and the patterns are compared as small integers.
    */
-  OverlappingWFCOptions options;
-
-  /**
-   * The array of the different patterns extracted from the input.
-   */
-  std::vector<Array2D<T>> patterns;
-
-  /**
-   * The underlying generic WFC algorithm.
-   */
-  WFC wfc;
+  static CompiledInput compile(const Array2D<T> &input,
+                               const OverlappingWFCOptions &options) noexcept {
+    CompiledInput compiled(options.pattern_size);
+    std::vector<unsigned> indices(input.data.size());
+    {
+      FAST_WFC_STATS(
+          ScopedTimer timer(compiled.stats.pattern_extraction_time);)
+      std::unordered_map<T, unsigned> palette_ids;
+      for (std::size_t i = 0; i < input.data.size(); i++) {
+        // Neighbor pixels are often the same, and the lookup is skipped.
+        if (i > 0 && input.data[i] == input.data[i - 1]) {
+          indices[i] = indices[i - 1];
+          continue;
+        }
+        auto inserted = palette_ids.emplace(
+            input.data[i], static_cast<unsigned>(compiled.palette.size()));
+        if (inserted.second) {
+          compiled.palette.push_back(input.data[i]);
+        }
+        indices[i] = inserted.first->second;
+      }
+    }
 
-  /**
-   * Constructor initializing the wfc.
-   * This constructor is called by the other constructors.
-   * This is necessary in order to initialize wfc only once.
-   */
-  OverlappingWFC(
-      const Array2D<T> &input, const OverlappingWFCOptions &options,
-      const int &seed,
-      const std::pair<std::vector<Array2D<T>>, std::vector<double>> &patterns,
-      const std::vector<std::array<std::vector<unsigned>, 4>>
-          &propagator) noexcept
-      : input(input), options(options), patterns(patterns.first),
-        wfc(options.periodic_output, seed, patterns.second, propagator,
-            options.get_wave_height(), options.get_wave_width()) {
-    // If necessary, the ground is set.
-    if (options.ground) {
-      init_ground(wfc, input, patterns.first, options);
+    std::size_t palette_size = compiled.palette.size();
+    if (palette_size <= std::size_t(std::numeric_limits<uint8_t>::max()) + 1) {
+      compile_indices<uint8_t>(input, indices, options, compiled);
+    } else if (palette_size <=
+               std::size_t(std::numeric_limits<uint16_t>::max()) + 1) {
+      compile_indices<uint16_t>(input, indices, options, compiled);
+    } else {
+      compile_indices<uint32_t>(input, indices, options, compiled);
     }
+    return compiled;
   }
 
   /**
-   * Constructor used only to call the other constructor with more computed
-   * parameters.
-   */
-  OverlappingWFC(const Array2D<T> &input, const OverlappingWFCOptions &options,
-                 const int &seed,
-                 const std::pair<std::vector<Array2D<T>>, std::vector<double>>
-                     &patterns) noexcept
-      : OverlappingWFC(input, options, seed, patterns,
-                       generate_compatible(patterns.first)) {}
-
-  /**
-   * Init the ground of the output image.
-   * The lowest middle pattern is used as a floor (and ceiling when the input is
-   * toric) and is placed at the lowest possible pattern position in the output
-   * image, on all its width. The pattern cannot be used at any other place in
-   * the output image.
+   * Extract the patterns and the rules of input, whose pixels have been
+   * replaced by indices in compiled.palette, stored as Index.
    */
-  void init_ground(WFC &wfc, const Array2D<T> &input,
-                   const std::vector<Array2D<T>> &patterns,
-                   const OverlappingWFCOptions &options) noexcept {
-    unsigned ground_pattern_id =
-        get_ground_pattern_id(input, patterns, options);
-
-    // Place the pattern in the ground.
-    for (unsigned j = 0; j < options.get_wave_width(); j++) {
-      set_pattern(ground_pattern_id, options.get_wave_height() - 1, j);
+  template <typename Index>
+  static void compile_indices(const Array2D<T> &input,
+                              const std::vector<unsigned> &indices,
+                              const OverlappingWFCOptions &options,
+                              CompiledInput &compiled) noexcept {
+    std::vector<Array2D<Index>> patterns;
+    Array2D<Index> indexed_input(input.height, input.width);
+    {
+      FAST_WFC_STATS(
+          ScopedTimer timer(compiled.stats.pattern_extraction_time);)
+      for (std::size_t i = 0; i < indices.size(); i++) {
+        indexed_input.data[i] = static_cast<Index>(indices[i]);
+      }
+      PatternExtractor<Index>(indexed_input, options.pattern_size,
+                              options.symmetry, options.periodic_input)
+          .extract(options.nb_model_threads, patterns, compiled.weights);
     }
 
-    // Remove the pattern from the other positions.
-    for (unsigned i = 0; i < options.get_wave_height() - 1; i++) {
-      for (unsigned j = 0; j < options.get_wave_width(); j++) {
-        wfc.remove_wave_pattern(i, j, ground_pattern_id);
+    compiled.compatible = generate_compatible(
+        patterns, options.nb_model_threads, compiled.stats);
+
+    // The pixels are only needed to draw the output and to look patterns up.
+    // The patterns are distinct, so they keep their ids in the arena.
+    compiled.patterns.reserve(patterns.size());
+    std::vector<T> pixels(options.pattern_size * options.pattern_size);
+    for (const Array2D<Index> &pattern : patterns) {
+      for (std::size_t i = 0; i < pattern.data.size(); i++) {
+        pixels[i] = compiled.palette[pattern.data[i]];
       }
+      compiled.patterns.insert(pixels.data());
     }
 
-    // Propagate the information with wfc.
-    wfc.propagate();
+    // The lowest middle pattern is in the input, so it is always found.
+    if (options.ground) {
+      compiled.ground_pattern_id = compiled.patterns.find(
+          input.get_sub_array(input.height - 1, input.width / 2,
+                              options.pattern_size, options.pattern_size));
+      assert(compiled.ground_pattern_id);
+    }
   }
 
   /**
-   * Return the id of the lowest middle pattern.
+   * Return the part of pattern that overlaps the pattern placed next to it in
+   * direction: every row but the last one if the other pattern is above it,
+   * and so on.
    */
-  static unsigned
-  get_ground_pattern_id(const Array2D<T> &input,
-                        const std::vector<Array2D<T>> &patterns,
-                        const OverlappingWFCOptions &options) noexcept {
-    // Get the pattern.
-    Array2D<T> ground_pattern =
-        input.get_sub_array(input.height - 1, input.width / 2,
-                            options.pattern_size, options.pattern_size);
-
-    // Retrieve the id of the pattern.
-    for (unsigned i = 0; i < patterns.size(); i++) {
-      if (ground_pattern == patterns[i]) {
-        return i;
+  template <typename Pixel>
+  static Array2D<Pixel> get_overlap(const Array2D<Pixel> &pattern,
+                                    unsigned direction) noexcept {
+    int dy = directions_y[direction];
+    int dx = directions_x[direction];
+    unsigned y0 = dy > 0 ? 1 : 0;
+    unsigned x0 = dx > 0 ? 1 : 0;
+    Array2D<Pixel> overlap(pattern.height - (dy != 0),
+                           pattern.width - (dx != 0));
+    for (unsigned y = 0; y < overlap.height; y++) {
+      for (unsigned x = 0; x < overlap.width; x++) {
+        overlap.get(y, x) = pattern.get(y + y0, x + x0);
       }
     }
-
-    // The pattern exists.
-    assert(false);
-    return 0;
+    return overlap;
   }
 
   /**
-   * Return the list of patterns, as well as their probabilities of apparition.
-   */
-  static std::pair<std::vector<Array2D<T>>, std::vector<double>>
-  get_patterns(const Array2D<T> &input,
-               const OverlappingWFCOptions &options) noexcept {
-    std::unordered_map<Array2D<T>, unsigned> patterns_id;
-    std::vector<Array2D<T>> patterns;
-
-    // The number of time a pattern is seen in the input image.
-    std::vector<double> patterns_weight;
-
-    std::vector<Array2D<T>> symmetries(
-        8, Array2D<T>(options.pattern_size, options.pattern_size));
-    unsigned max_i = options.periodic_input
-                         ? input.height
-                         : input.height - options.pattern_size + 1;
-    unsigned max_j = options.periodic_input
-                         ? input.width
-                         : input.width - options.pattern_size + 1;
-
-    for (unsigned i = 0; i < max_i; i++) {
-      for (unsigned j = 0; j < max_j; j++) {
-        // Compute the symmetries of every pattern in the image.
-        symmetries[0].data =
-            input
-                .get_sub_array(i, j, options.pattern_size, options.pattern_size)
-                .data;
-        symmetries[1].data = symmetries[0].reflected().data;
-        symmetries[2].data = symmetries[0].rotated().data;
-        symmetries[3].data = symmetries[2].reflected().data;
-        symmetries[4].data = symmetries[2].rotated().data;
-        symmetries[5].data = symmetries[4].reflected().data;
-        symmetries[6].data = symmetries[4].rotated().data;
-        symmetries[7].data = symmetries[6].reflected().data;
-
-        // The number of symmetries in the option class define which symetries
-        // will be used.
-        for (unsigned k = 0; k < options.symmetry; k++) {
-          auto res = patterns_id.insert(
-              std::make_pair(symmetries[k], patterns.size()));
-
-          // If the pattern already exist, we just have to increase its number
-          // of appearance.
-          if (!res.second) {
-            patterns_weight[res.first->second] += 1;
-          } else {
-            patterns.push_back(symmetries[k]);
-            patterns_weight.push_back(1);
+   * Return, for every pattern1 and direction, the patterns pattern2 that agree
+   * with pattern1 when pattern2 is placed next to it in direction (see
+   * direction.hpp): the pixels of the two patterns are the same where they
+   * overlap.
+   * This is a hash join: two patterns agree if and only if the overlap of
+   * pattern1 in direction is equal to the overlap of pattern2 in the opposite
+   * direction, so the patterns are grouped by overlap in every direction, and
+   * the list of pattern1 is the group of its overlap in the opposite
+   * direction. The four directions are grouped concurrently, and the lists
+   * are then looked up on n_threads threads (0 meaning one per core), so the
+   * time is linear in the size of the result instead of quadratic in the
+   * number of patterns.
+   * The time spent is added to stats.
+   */
+  template <typename Pixel>
+  static Model::PropagatorState
+  generate_compatible(const std::vector<Array2D<Pixel>> &patterns,
+                      unsigned n_threads,
+                      [[maybe_unused]] WFCStats &stats) noexcept {
+    FAST_WFC_STATS(ScopedTimer timer(stats.compatible_generation_time);)
+    const unsigned nb_patterns = static_cast<unsigned>(patterns.size());
+
+    // patterns_with_overlap[direction][overlap] is the list of the patterns
+    // whose overlap in direction is overlap, in increasing order.
+    std::array<std::unordered_map<Array2D<Pixel>, std::vector<unsigned>>, 4>
+        patterns_with_overlap;
+    parallel_for(n_threads, 4, [&](std::size_t direction) {
+      for (unsigned pattern = 0; pattern < nb_patterns; pattern++) {
+        patterns_with_overlap[direction]
+                             [get_overlap(patterns[pattern],
+                                          static_cast<unsigned>(direction))]
+                                 .push_back(pattern);
+      }
+    });
+
+    Model::PropagatorState compatible(nb_patterns);
+    std::size_t nb_blocks =
+        (nb_patterns + compatible_block_size - 1) / compatible_block_size;
+    parallel_for(n_threads, nb_blocks, [&](std::size_t block) {
+      unsigned begin = static_cast<unsigned>(block * compatible_block_size);
+      unsigned end = std::min(begin + compatible_block_size, nb_patterns);
+      for (unsigned pattern1 = begin; pattern1 < end; pattern1++) {
+        for (unsigned direction = 0; direction < 4; direction++) {
+          const auto &groups =
+              patterns_with_overlap[get_opposite_direction(direction)];
+          auto group =
+              groups.find(get_overlap(patterns[pattern1], direction));
+          if (group != groups.end()) {
+            compatible[pattern1][direction] = group->second;
           }
         }
       }
-    }
+    });
 
-    return {patterns, patterns_weight};
+    return compatible;
   }
 
   /**
-   * Return true if the pattern1 is compatible with pattern2
-   * when pattern2 is at a distance (dy,dx) from pattern1.
+   * The number of patterns whose lists are copied by one task of
+   * generate_compatible.
    */
-  static bool agrees(const Array2D<T> &pattern1, const Array2D<T> &pattern2,
-                     int dy, int dx) noexcept {
-    unsigned xmin = dx < 0 ? 0 : dx;
-    unsigned xmax = dx < 0 ? dx + pattern2.width : pattern1.width;
-    unsigned ymin = dy < 0 ? 0 : dy;
-    unsigned ymax = dy < 0 ? dy + pattern2.height : pattern1.width;
+  static constexpr unsigned compatible_block_size = 256;
 
-    // Iterate on every pixel contained in the intersection of the two pattern.
-    for (unsigned y = ymin; y < ymax; y++) {
-      for (unsigned x = xmin; x < xmax; x++) {
-        // Check if the color is the same in the two patterns in that pixel.
-        if (pattern1.get(y, x) != pattern2.get(y - dy, x - dx)) {
-          return false;
-        }
-      }
-    }
-    return true;
-  }
+  /**
+   * Constructor used only to call the other constructor with the compiled
+   * input.
+   */
+  OverlappingModel(CompiledInput &&compiled) noexcept
+      : palette(std::move(compiled.palette)),
+        patterns(std::move(compiled.patterns)),
+        ground_pattern_id(compiled.ground_pattern_id),
+        wfc_model(std::make_shared<const Model>(std::move(compiled.weights),
+                                                compiled.compatible)),
+        stats(compiled.stats) {}
 
+public:
   /**
-   * Precompute the function agrees(pattern1, pattern2, dy, dx).
-   * If agrees(pattern1, pattern2, dy, dx), then compatible[pattern1][direction]
-   * contains pattern2, where direction is the direction defined by (dy, dx)
-   * (see direction.hpp).
+   * The distinct pixels of the input, in the order in which they are seen.
    */
-  static std::vector<std::array<std::vector<unsigned>, 4>>
-  generate_compatible(const std::vector<Array2D<T>> &patterns) noexcept {
-    std::vector<std::array<std::vector<unsigned>, 4>> compatible =
-        std::vector<std::array<std::vector<unsigned>, 4>>(patterns.size());
+  const std::vector<T> palette;
 
-    // Iterate on every dy, dx, pattern1 and pattern2
-    for (unsigned pattern1 = 0; pattern1 < patterns.size(); pattern1++) {
-      for (unsigned direction = 0; direction < 4; direction++) {
-        for (unsigned pattern2 = 0; pattern2 < patterns.size(); pattern2++) {
-          if (agrees(patterns[pattern1], patterns[pattern2],
-                     directions_y[direction], directions_x[direction])) {
-            compatible[pattern1][direction].push_back(pattern2);
-          }
-        }
+  /**
+   * The different patterns extracted from the input, stored contiguously and
+   * indexed by their pixels.
+   */
+  const PatternArena<T> patterns;
+
+  /**
+   * If the ground option is set, the id of the lowest middle pattern.
+   */
+  const std::optional<unsigned> ground_pattern_id;
+
+  /**
+   * The frequencies of the patterns and the compiled rules, used by the
+   * underlying generic WFC algorithm.
+   */
+  const std::shared_ptr<const Model> wfc_model;
+
+  /**
+   * The time spent extracting the patterns and generating the rules, if
+   * FAST_WFC_ENABLE_STATS is defined.
+   */
+  const WFCStats stats;
+
+  /**
+   * Extract the patterns of input and compile the rules.
+   */
+  OverlappingModel(const Array2D<T> &input,
+                   const OverlappingWFCOptions &options) noexcept
+      : OverlappingModel(compile(input, options)) {}
+};
+
+/**
+ * Class generating a new image with the overlapping WFC algorithm.
+ */
+template <typename T> class OverlappingWFC {
+
+private:
+  /**
+   * The patterns and the rules, shared with the other instances built from
+   * the same model.
+   */
+  std::shared_ptr<const OverlappingModel<T>> model;
+
+  /**
+   * Options needed by the algorithm.
+   */
+  OverlappingWFCOptions options;
+
+  /**
+   * The underlying generic WFC algorithm.
+   */
+  WFC wfc;
+
+  /**
+   * Init the ground of the output image.
+   * The lowest middle pattern is used as a floor (and ceiling when the input is
+   * toric) and is placed at the lowest possible pattern position in the output
+   * image, on all its width. The pattern cannot be used at any other place in
+   * the output image.
+   * Return false if the ground leads to a contradiction.
+   */
+  bool init_ground() noexcept {
+    unsigned ground_pattern_id = *model->ground_pattern_id;
+
+    // Place the pattern in the ground.
+    for (unsigned j = 0; j < options.get_wave_width(); j++) {
+      set_pattern(ground_pattern_id, options.get_wave_height() - 1, j);
+    }
+
+    // Remove the pattern from the other positions.
+    for (unsigned i = 0; i < options.get_wave_height() - 1; i++) {
+      for (unsigned j = 0; j < options.get_wave_width(); j++) {
+        wfc.remove_wave_pattern(i, j, ground_pattern_id);
       }
     }
 
-    return compatible;
+    // Propagate the information with wfc.
+    return wfc.propagate();
   }
 
   /**
    * Transform a 2D array containing the patterns id to a 2D array containing
    * the pixels.
    */
-  Array2D<T> to_image(const Array2D<unsigned> &output_patterns) const noexcept {
+  static Array2D<T> to_image(const PatternArena<T> &patterns,
+                             const OverlappingWFCOptions &options,
+                             const Array2D<unsigned> &output_patterns) noexcept {
     Array2D<T> output = Array2D<T>(options.out_height, options.out_width);
 
     if (options.periodic_output) {
       for (unsigned y = 0; y < options.get_wave_height(); y++) {
         for (unsigned x = 0; x < options.get_wave_width(); x++) {
-          output.get(y, x) = patterns[output_patterns.get(y, x)].get(0, 0);
+          output.get(y, x) = patterns.get(output_patterns.get(y, x), 0, 0);
         }
       }
     } else {
       for (unsigned y = 0; y < options.get_wave_height(); y++) {
         for (unsigned x = 0; x < options.get_wave_width(); x++) {
-          output.get(y, x) = patterns[output_patterns.get(y, x)].get(0, 0);
+          output.get(y, x) = patterns.get(output_patterns.get(y, x), 0, 0);
         }
       }
       for (unsigned y = 0; y < options.get_wave_height(); y++) {
-        const Array2D<T> &pattern =
-            patterns[output_patterns.get(y, options.get_wave_width() - 1)];
+        unsigned pattern =
+            output_patterns.get(y, options.get_wave_width() - 1);
         for (unsigned dx = 1; dx < options.pattern_size; dx++) {
-          output.get(y, options.get_wave_width() - 1 + dx) = pattern.get(0, dx);
+          output.get(y, options.get_wave_width() - 1 + dx) =
+              patterns.get(pattern, 0, dx);
         }
       }
       for (unsigned x = 0; x < options.get_wave_width(); x++) {
-        const Array2D<T> &pattern =
-            patterns[output_patterns.get(options.get_wave_height() - 1, x)];
+        unsigned pattern =
+            output_patterns.get(options.get_wave_height() - 1, x);
         for (unsigned dy = 1; dy < options.pattern_size; dy++) {
           output.get(options.get_wave_height() - 1 + dy, x) =
-              pattern.get(dy, 0);
+              patterns.get(pattern, dy, 0);
         }
       }
-      const Array2D<T> &pattern = patterns[output_patterns.get(
-          options.get_wave_height() - 1, options.get_wave_width() - 1)];
+      unsigned pattern = output_patterns.get(options.get_wave_height() - 1,
+                                             options.get_wave_width() - 1);
       for (unsigned dy = 1; dy < options.pattern_size; dy++) {
         for (unsigned dx = 1; dx < options.pattern_size; dx++) {
           output.get(options.get_wave_height() - 1 + dy,
-                     options.get_wave_width() - 1 + dx) = pattern.get(dy, dx);
+                     options.get_wave_width() - 1 + dx) =
+              patterns.get(pattern, dy, dx);
         }
       }
     }
@@ -298,26 +393,12 @@ private:
     return output;
   }
 
-  std::optional<unsigned> get_pattern_id(const Array2D<T> &pattern) {
-    unsigned* pattern_id = std::find(patterns.begin(), patterns.end(), pattern);
-
-    if (pattern_id != patterns.end()) {
-      return *pattern_id;
-    }
-
-    return std::nullopt;
-  }
-
   /**
    * Set the pattern at a specific position, given its pattern id
    * pattern_id needs to be a valid pattern id, and i and j needs to be in the wave range
    */
   void set_pattern(unsigned pattern_id, unsigned i, unsigned j) noexcept {
-    for (unsigned p = 0; p < patterns.size(); p++) {
-      if (pattern_id != p) {
-        wfc.remove_wave_pattern(i, j, p);
-      }
-    }
+    wfc.set_pattern(i, j, pattern_id);
   }
 
 public:
@@ -326,12 +407,33 @@ public:
    */
   OverlappingWFC(const Array2D<T> &input, const OverlappingWFCOptions &options,
                  int seed) noexcept
-      : OverlappingWFC(input, options, seed, get_patterns(input, options)) {}
+      : OverlappingWFC(std::make_shared<const OverlappingModel<T>>(input,
+                                                                   options),
+                       options, seed) {}
+
+  /**
+   * Constructor borrowing a model, which should have been built with the same
+   * periodic_input, symmetry, ground and pattern_size options. Only the state
+   * of the run is allocated.
+   */
+  OverlappingWFC(std::shared_ptr<const OverlappingModel<T>> model,
+                 const OverlappingWFCOptions &options, int seed) noexcept
+      : model(std::move(model)), options(options),
+        wfc(options.periodic_output, seed, this->model->wfc_model,
+            options.get_wave_height(), options.get_wave_width(),
+            options.wfc_options) {
+    // If necessary, the ground is set. If it leads to a contradiction, the
+    // wave is left impossible and run fails at once.
+    if (options.ground) {
+      init_ground();
+    }
+  }
 
   /**
-   * Set the pattern at a specific position.
-   * Returns false if the given pattern does not exist, or if the
-   * coordinates are not in the wave
+   * Set the pattern at a specific position, and propagate it.
+   * Returns false if the given pattern does not exist, if the
+   * coordinates are not in the wave, or if the pattern leads to a
+   * contradiction
    */
   bool set_pattern(const Array2D<T>& pattern, unsigned i, unsigned j) noexcept {
     auto pattern_id = get_pattern_id(pattern);
@@ -340,20 +442,109 @@ public:
       return false;
     }
 
-    set_pattern(pattern_id, i, j);
-    return true;
+    set_pattern(*pattern_id, i, j);
+    return wfc.propagate();
+  }
+
+  /**
+   * Return the id of pattern in the model, or nullopt if pattern was not
+   * extracted from the input. This is a hash lookup.
+   */
+  std::optional<unsigned> get_pattern_id(const Array2D<T> &pattern) const
+      noexcept {
+    return model->patterns.find(pattern);
+  }
+
+  /**
+   * Return the current state of the algorithm, for instance after the
+   * constraints have been set.
+   */
+  WFC::Snapshot snapshot() const noexcept { return wfc.snapshot(); }
+
+  /**
+   * Go back to a state returned by snapshot, and reseed the algorithm. This
+   * is much cheaper than building a new object with the new seed.
+   */
+  void restore(const WFC::Snapshot &snapshot, int seed) noexcept {
+    wfc.restore(snapshot, seed);
   }
 
   /**
    * Run the WFC algorithm, and return the result if the algorithm succeeded.
    */
   std::optional<Array2D<T>> run() noexcept {
-    std::optional<Array2D<unsigned>> result = wfc.run();
-    if (result.has_value()) {
-      return to_image(*result);
+    if (wfc.step(std::numeric_limits<std::size_t>::max()) == WFC::success) {
+      return to_image(model->patterns, options, wfc.get_output());
     }
     return std::nullopt;
   }
+
+  /**
+   * Return the statistics of the algorithm since its construction, with the
+   * time spent building the model. See WFC::get_stats.
+   */
+  WFCStats get_stats() const noexcept {
+    WFCStats result = wfc.get_stats();
+    result += model->stats;
+    return result;
+  }
+
+  /**
+   * Run the algorithm from where it stopped for about budget, so it can be
+   * spread over several frames. Once it returns WFC::success, run returns the
+   * result immediately. See WFC::run_for.
+   */
+  WFC::ObserveStatus run_for(std::chrono::nanoseconds budget) noexcept {
+    return wfc.run_for(budget);
+  }
+
+  /**
+   * Run the algorithm from the current state with every seed of seeds, on
+   * n_threads threads, and return the first seed of the list that succeeded
+   * with its result. See WFC::run_parallel.
+   */
+  std::optional<std::pair<int, Array2D<T>>>
+  run_parallel(unsigned n_threads, const std::vector<int> &seeds) const {
+    auto result = wfc.run_parallel(n_threads, seeds);
+    if (!result.has_value()) {
+      return std::nullopt;
+    }
+    return std::make_pair(result->first,
+                          to_image(model->patterns, options, result->second));
+  }
+
+  /**
+   * Generate an image with model by solving the wave in blocks, on several
+   * threads (see BlockWFC). This is meant for large outputs. The output is
+   * never toric, so nullopt is returned if options.periodic_output is true.
+   */
+  static std::optional<Array2D<T>>
+  run_blocks(const std::shared_ptr<const OverlappingModel<T>> &model,
+             const OverlappingWFCOptions &options,
+             const BlockWFCOptions &block_options, int seed) noexcept {
+    // The seams of a toric output would not be constrained.
+    if (options.periodic_output) {
+      return std::nullopt;
+    }
+
+    BlockWFC wfc(model->wfc_model, options.get_wave_height(),
+                 options.get_wave_width(), block_options, seed);
+
+    // If necessary, the ground is set as in init_ground.
+    if (options.ground) {
+      unsigned ground_pattern_id = *model->ground_pattern_id;
+      for (unsigned j = 0; j < options.get_wave_width(); j++) {
+        wfc.set_pattern(options.get_wave_height() - 1, j, ground_pattern_id);
+      }
+      wfc.ban_pattern(ground_pattern_id);
+    }
+
+    std::optional<Array2D<unsigned>> result = wfc.run();
+    if (!result.has_value()) {
+      return std::nullopt;
+    }
+    return to_image(model->patterns, options, *result);
+  }
 };
 
 #endif // FAST_WFC_WFC_HPP_
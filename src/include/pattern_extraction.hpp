@@ -0,0 +1,431 @@
+#ifndef FAST_WFC_PATTERN_EXTRACTION_HPP_
+#define FAST_WFC_PATTERN_EXTRACTION_HPP_
+
+#include <algorithm>
+#include <cstdint>
+#include <functional>
+#include <limits>
+#include <utility>
+#include <vector>
+
+#include "utils/array2D.hpp"
+#include "utils/parallel.hpp"
+
+/**
+ * Extract the distinct square patterns of an input, and count how many times
+ * each of them is seen, as if every window of the input and its symmetries
+ * were copied and inserted in a hash map, but without any copy.
+ *
+ * The hash of a pattern P of size N is the sum of h(P[a][b]) * X^a * Y^b
+ * modulo 2^64, where h is std::hash<T>. Every symmetry of a window is a
+ * transposition and/or a reflection of its rows and columns, so its hash is a
+ * weighted sum of the hashes of the rows of the window. The hashes of the rows
+ * are rolled along every row of the input, so the hashes of the 8 symmetries
+ * of all the windows are computed in O(1) per window and per symmetry (for a
+ * fixed N). Two windows are only compared pixel by pixel if they have the
+ * same hash.
+ *
+ * The input is cut in bands of rows extracted on several threads, and the
+ * bands are merged in order, so the ids and the weights of the patterns are the
+ * same as with a sequential scan, whatever the number of threads.
+ */
+template <typename T> class PatternExtractor {
+private:
+  /**
+   * The id of no pattern.
+   */
+  static constexpr unsigned npos = std::numeric_limits<unsigned>::max();
+
+  /**
+   * A window of the input, seen with one of its symmetries.
+   */
+  struct Window {
+    unsigned y;        // The row of the top left pixel of the window.
+    unsigned x;        // The column of the top left pixel of the window.
+    unsigned symmetry; // The symmetry, in the order of the overlapping wfc.
+  };
+
+  /**
+   * A symmetry of a window, written as a transposition and reflections.
+   * The pixel (a, b) of the pattern is the pixel (r(b), c(a)) of the window if
+   * it is transposed, and (r(a), c(b)) otherwise, where r(x) is N - 1 - x if
+   * the rows are reflected and x otherwise, and c(x) is defined likewise.
+   */
+  struct Symmetry {
+    bool transposed;
+    bool reflected_rows;
+    bool reflected_columns;
+  };
+
+  /**
+   * The symmetries of a window, in the order used by the overlapping wfc: the
+   * window, then alternately rotated 90° anticlockwise and reflected.
+   */
+  static constexpr Symmetry symmetries[8] = {
+      {false, false, false}, {false, false, true}, {true, false, true},
+      {true, true, true},    {false, true, true},  {false, true, false},
+      {true, true, false},   {true, false, false}};
+
+  /**
+   * The patterns found in a band, with the first window where they are seen,
+   * in the order in which they are first seen.
+   * They are indexed by an open addressing hash table with linear probing,
+   * whose slots contain the hashes and the ids of the patterns, the id being
+   * npos if the slot is empty.
+   */
+  struct PatternSet {
+    struct Slot {
+      uint64_t hash;
+      unsigned id;
+    };
+
+    std::vector<Window> windows;
+    std::vector<uint64_t> hashes;
+    std::vector<double> weights;
+    std::vector<Slot> slots = std::vector<Slot>(64, Slot{0, npos});
+
+    /**
+     * Return the first slot to look at for hash. The high bits of the product
+     * depend on all the bits of the hash.
+     */
+    std::size_t get_slot(uint64_t hash) const noexcept {
+      return static_cast<std::size_t>((hash * 0x9e3779b97f4a7c15) >> 32) &
+             (slots.size() - 1);
+    }
+
+    /**
+     * Return the id of the pattern of window, or npos if it is not in the set.
+     * The windows are only compared if they have the same hash.
+     */
+    template <typename Equal>
+    unsigned find(uint64_t hash, const Window &window,
+                  Equal &&equal) const noexcept {
+      for (std::size_t slot = get_slot(hash); slots[slot].id != npos;
+           slot = (slot + 1) & (slots.size() - 1)) {
+        if (slots[slot].hash == hash &&
+            equal(windows[slots[slot].id], window)) {
+          return slots[slot].id;
+        }
+      }
+      return npos;
+    }
+
+    /**
+     * Add the pattern of window, seen weight times. It should not be in the
+     * set.
+     */
+    void insert(uint64_t hash, const Window &window, double weight) {
+      unsigned id = static_cast<unsigned>(windows.size());
+      windows.push_back(window);
+      hashes.push_back(hash);
+      weights.push_back(weight);
+
+      // The table is kept at most half full.
+      if (2 * windows.size() > slots.size()) {
+        slots.assign(2 * slots.size(), Slot{0, npos});
+        for (unsigned other = 0; other < id; other++) {
+          place(other);
+        }
+      }
+      place(id);
+    }
+
+    /**
+     * Store id in the first empty slot for its hash.
+     */
+    void place(unsigned id) noexcept {
+      std::size_t slot = get_slot(hashes[id]);
+      while (slots[slot].id != npos) {
+        slot = (slot + 1) & (slots.size() - 1);
+      }
+      slots[slot] = {hashes[id], id};
+    }
+  };
+
+  /**
+   * The bases of the hash, for the rows and for the columns of a pattern.
+   * They are odd, so they can be inverted modulo 2^64.
+   */
+  static constexpr uint64_t base_x = 0x9e3779b97f4a7c15;
+  static constexpr uint64_t base_y = 0xc2b2ae3d27d4eb4f;
+
+  /**
+   * The number of rows of the input extracted by one task.
+   */
+  static constexpr unsigned band_height = 64;
+
+  const Array2D<T> &input;
+  const unsigned pattern_size;
+  const unsigned symmetry;
+
+  /**
+   * The number of windows in a column and in a row of the input.
+   */
+  const unsigned max_i;
+  const unsigned max_j;
+
+  /**
+   * powers_x[n] is base_x^n, for n in [0, pattern_size], and likewise for
+   * base_y.
+   */
+  std::vector<uint64_t> powers_x;
+  std::vector<uint64_t> powers_y;
+
+  /**
+   * offsets[k][a * N + b] is the offset in input.data of the pixel (a, b) of
+   * the symmetry k of a window, from the top left pixel of the window. It is
+   * only valid for the windows that do not wrap around the input.
+   */
+  std::vector<std::size_t> offsets[8];
+
+  /**
+   * Return the inverse of an odd number modulo 2^64, by Newton's method.
+   */
+  static constexpr uint64_t inverse(uint64_t n) noexcept {
+    uint64_t result = n;
+    for (unsigned i = 0; i < 5; i++) {
+      result *= 2 - n * result;
+    }
+    return result;
+  }
+
+  /**
+   * Return the position in a window of the pixel (a, b) of its symmetry k.
+   */
+  std::pair<unsigned, unsigned> get_position(unsigned k, unsigned a,
+                                             unsigned b) const noexcept {
+    const Symmetry &s = symmetries[k];
+    unsigned row = s.transposed ? b : a;
+    unsigned column = s.transposed ? a : b;
+    if (s.reflected_rows) {
+      row = pattern_size - 1 - row;
+    }
+    if (s.reflected_columns) {
+      column = pattern_size - 1 - column;
+    }
+    return {row, column};
+  }
+
+  /**
+   * Return the pixel (a, b) of window.
+   */
+  const T &get_pixel(const Window &window, unsigned a,
+                     unsigned b) const noexcept {
+    auto [row, column] = get_position(window.symmetry, a, b);
+    return input.get((window.y + row) % input.height,
+                     (window.x + column) % input.width);
+  }
+
+  /**
+   * Return true if window wraps around the input.
+   */
+  bool wraps(const Window &window) const noexcept {
+    return window.y + pattern_size > input.height ||
+           window.x + pattern_size > input.width;
+  }
+
+  /**
+   * Return true if window1 and window2 are the same pattern.
+   */
+  bool are_equal(const Window &window1, const Window &window2) const noexcept {
+    if (wraps(window1) || wraps(window2)) {
+      for (unsigned a = 0; a < pattern_size; a++) {
+        for (unsigned b = 0; b < pattern_size; b++) {
+          if (get_pixel(window1, a, b) != get_pixel(window2, a, b)) {
+            return false;
+          }
+        }
+      }
+      return true;
+    }
+
+    // Most windows do not wrap, and their pixels are read without any modulo.
+    const T *pixels1 = &input.data[window1.y * input.width + window1.x];
+    const T *pixels2 = &input.data[window2.y * input.width + window2.x];
+    const std::size_t *offsets1 = offsets[window1.symmetry].data();
+    const std::size_t *offsets2 = offsets[window2.symmetry].data();
+    for (unsigned i = 0; i < pattern_size * pattern_size; i++) {
+      if (pixels1[offsets1[i]] != pixels2[offsets2[i]]) {
+        return false;
+      }
+    }
+    return true;
+  }
+
+  /**
+   * Compute the hashes of the row y of the input, for the windows starting at
+   * every column in [0, max_j). hashes[j * 4 + k] is the sum over the columns
+   * c of the window of h(pixel) times, for k = 0 to 3, base_y^c,
+   * base_y^(N - 1 - c), base_x^c and base_x^(N - 1 - c).
+   * values is a buffer for the hashes of the pixels.
+   */
+  void hash_row(unsigned y, std::vector<uint64_t> &values,
+                uint64_t *hashes) const noexcept {
+    const unsigned n = pattern_size;
+    const unsigned nb_values = max_j + n - 1;
+    values.resize(nb_values);
+    for (unsigned x = 0; x < nb_values; x++) {
+      values[x] = std::hash<T>()(input.get(y, x % input.width));
+    }
+
+    uint64_t sums[4] = {0, 0, 0, 0};
+    for (unsigned c = 0; c < n; c++) {
+      sums[0] += values[c] * powers_y[c];
+      sums[1] += values[c] * powers_y[n - 1 - c];
+      sums[2] += values[c] * powers_x[c];
+      sums[3] += values[c] * powers_x[n - 1 - c];
+    }
+
+    constexpr uint64_t inverse_y = inverse(base_y);
+    constexpr uint64_t inverse_x = inverse(base_x);
+    for (unsigned j = 0; j < max_j; j++) {
+      std::copy(sums, sums + 4, hashes + j * 4);
+      if (j + 1 == max_j) {
+        break;
+      }
+
+      // Remove the first pixel of the window, and add the one after it.
+      uint64_t removed = values[j];
+      uint64_t added = values[j + n];
+      sums[0] = (sums[0] - removed) * inverse_y + added * powers_y[n - 1];
+      sums[1] = (sums[1] - removed * powers_y[n - 1]) * base_y + added;
+      sums[2] = (sums[2] - removed) * inverse_x + added * powers_x[n - 1];
+      sums[3] = (sums[3] - removed * powers_x[n - 1]) * base_x + added;
+    }
+  }
+
+  /**
+   * Return the patterns of the windows starting in the rows [i0, i1), with
+   * their weights, in the order in which they are first seen.
+   */
+  PatternSet extract_band(unsigned i0, unsigned i1) const {
+    const unsigned n = pattern_size;
+    const unsigned nb_rows = i1 - i0 + n - 1;
+
+    // The hashes of every row used by the windows of the band.
+    std::vector<uint64_t> row_hashes(std::size_t(nb_rows) * max_j * 4);
+    std::vector<uint64_t> values;
+    for (unsigned row = 0; row < nb_rows; row++) {
+      hash_row((i0 + row) % input.height, values,
+               &row_hashes[std::size_t(row) * max_j * 4]);
+    }
+
+    auto equal = [&](const Window &window1, const Window &window2) {
+      return are_equal(window1, window2);
+    };
+    PatternSet set;
+    for (unsigned i = i0; i < i1; i++) {
+      for (unsigned j = 0; j < max_j; j++) {
+        for (unsigned k = 0; k < symmetry; k++) {
+          // The hash of a symmetry is the sum of the hashes of the rows of the
+          // window, weighted by the powers of the other base.
+          const Symmetry &s = symmetries[k];
+          unsigned row_hash = (s.transposed ? 2 : 0) + s.reflected_columns;
+          const std::vector<uint64_t> &powers =
+              s.transposed ? powers_y : powers_x;
+          uint64_t hash = 0;
+          for (unsigned r = 0; r < n; r++) {
+            std::size_t row = i - i0 + r;
+            hash += row_hashes[(row * max_j + j) * 4 + row_hash] *
+                    powers[s.reflected_rows ? n - 1 - r : r];
+          }
+
+          Window window = {i, j, k};
+          unsigned id = set.find(hash, window, equal);
+          if (id == npos) {
+            set.insert(hash, window, 1);
+          } else {
+            set.weights[id] += 1;
+          }
+        }
+      }
+    }
+    return set;
+  }
+
+public:
+  /**
+   * Prepare the extraction of the patterns of size pattern_size from input,
+   * with the first symmetry symmetries of every window (see
+   * OverlappingWFCOptions).
+   */
+  PatternExtractor(const Array2D<T> &input, unsigned pattern_size,
+                   unsigned symmetry, bool periodic_input) noexcept
+      : input(input), pattern_size(pattern_size), symmetry(symmetry),
+        max_i(periodic_input
+                  ? static_cast<unsigned>(input.height)
+                  : static_cast<unsigned>(input.height) - pattern_size + 1),
+        max_j(periodic_input
+                  ? static_cast<unsigned>(input.width)
+                  : static_cast<unsigned>(input.width) - pattern_size + 1),
+        powers_x(pattern_size + 1, 1), powers_y(pattern_size + 1, 1) {
+    for (unsigned n = 1; n <= pattern_size; n++) {
+      powers_x[n] = powers_x[n - 1] * base_x;
+      powers_y[n] = powers_y[n - 1] * base_y;
+    }
+    for (unsigned k = 0; k < 8; k++) {
+      for (unsigned a = 0; a < pattern_size; a++) {
+        for (unsigned b = 0; b < pattern_size; b++) {
+          auto [row, column] = get_position(k, a, b);
+          offsets[k].push_back(row * input.width + column);
+        }
+      }
+    }
+  }
+
+  /**
+   * Extract the patterns on n_threads threads (0 meaning as many threads as
+   * the hardware supports). The patterns are numbered in the order in which
+   * they are first seen, scanning the windows row by row and the symmetries of
+   * every window in order. weights[id] is the number of times the pattern id
+   * is seen.
+   */
+  void extract(unsigned n_threads, std::vector<Array2D<T>> &patterns,
+               std::vector<double> &weights) const {
+    patterns.clear();
+    weights.clear();
+    std::size_t nb_bands = (max_i + band_height - 1) / band_height;
+    if (nb_bands == 0) {
+      return;
+    }
+    std::vector<PatternSet> bands(nb_bands);
+    parallel_for(n_threads, nb_bands, [&](std::size_t band) {
+      unsigned i0 = static_cast<unsigned>(band) * band_height;
+      bands[band] = extract_band(i0, std::min(i0 + band_height, max_i));
+    });
+
+    // A pattern first seen in a band is after all the patterns of the
+    // previous bands, so merging the bands in order keeps the order of a
+    // sequential scan.
+    auto equal = [&](const Window &window1, const Window &window2) {
+      return are_equal(window1, window2);
+    };
+    PatternSet all = std::move(bands[0]);
+    for (std::size_t band = 1; band < nb_bands; band++) {
+      const PatternSet &set = bands[band];
+      for (unsigned id = 0; id < set.windows.size(); id++) {
+        unsigned all_id = all.find(set.hashes[id], set.windows[id], equal);
+        if (all_id == npos) {
+          all.insert(set.hashes[id], set.windows[id], set.weights[id]);
+        } else {
+          all.weights[all_id] += set.weights[id];
+        }
+      }
+      bands[band] = PatternSet();
+    }
+
+    patterns.reserve(all.windows.size());
+    for (const Window &window : all.windows) {
+      Array2D<T> pattern(pattern_size, pattern_size);
+      for (unsigned a = 0; a < pattern_size; a++) {
+        for (unsigned b = 0; b < pattern_size; b++) {
+          pattern.get(a, b) = get_pixel(window, a, b);
+        }
+      }
+      patterns.push_back(std::move(pattern));
+    }
+    weights = std::move(all.weights);
+  }
+};
+
+#endif // FAST_WFC_PATTERN_EXTRACTION_HPP_
@@ -2,31 +2,64 @@
 #define FAST_WFC_PROPAGATOR_HPP_
 
 #include "direction.hpp"
-#include "utils/array3D.hpp"
+#include "model.hpp"
+#include "stats.hpp"
+#include "utils/aligned_allocator.hpp"
+#include <algorithm>
+#include <array>
+#include <cstdint>
+#include <limits>
+#include <memory>
 #include <tuple>
+#include <variant>
 #include <vector>
-#include <array>
 
 class Wave;
 
+/**
+ * The order in which the compatibility counts are stored in memory.
+ */
+enum class CompatibleLayout {
+  pattern_major,   // The 4 counts of a (cell, pattern) are contiguous.
+  direction_major, // The counts of a (cell, direction) are contiguous.
+};
+
+/**
+ * The algorithm used to propagate the removal of patterns.
+ */
+enum class PropagationEngine {
+  automatic, // Choose one of the two engines with the density of the rules.
+  counters,  // Count the compatible patterns of every (cell, pattern).
+  bitsets,   // Intersect the neighbor cells with masks of compatible patterns.
+};
+
+/**
+ * The result of a propagation.
+ */
+enum class PropagationStatus {
+  done,          // Every element was propagated.
+  paused,        // The budget was exhausted before the end.
+  contradiction, // A cell of the wave has no pattern left.
+};
+
 /**
  * Propagate information about patterns in the wave.
  */
 class Propagator {
 public:
-  using PropagatorState = std::vector<std::array<std::vector<unsigned>, 4>>;
+  using PropagatorState = Model::PropagatorState;
 
 private:
   /**
-   * The size of the patterns.
+   * The model, containing the table of the patterns that can be placed next
+   * to each other.
    */
-  const std::size_t patterns_size;
+  std::shared_ptr<const Model> model;
 
   /**
-   * propagator[pattern1][direction] contains all the patterns that can
-   * be placed in next to pattern1 in the direction direction.
+   * The size of the patterns.
    */
-  PropagatorState propagator_state;
+  const std::size_t patterns_size;
 
   /**
    * The wave width and height.
@@ -39,6 +72,17 @@ private:
    */
   const bool periodic_output;
 
+  /**
+   * The engine used, which is never automatic.
+   */
+  const PropagationEngine engine;
+
+  /**
+   * Return the engine to use for the model when engine is automatic.
+   */
+  static PropagationEngine choose_engine(PropagationEngine engine,
+                                         const Model &model) noexcept;
+
   /**
    * All the tuples (y, x, pattern) that should be propagated.
    * The tuple should be propagated when wave.get(y, x, pattern) is set to
@@ -47,30 +91,154 @@ private:
   std::vector<std::tuple<unsigned, unsigned, unsigned>> propagating;
 
   /**
-   * compatible.get(y, x, pattern)[direction] contains the number of patterns
-   * present in the wave that can be placed in the cell next to (y,x) in the
+   * The count of (cell, pattern, direction) contains the number of patterns
+   * present in the wave that can be placed in the cell next to cell in the
    * opposite direction of direction without being in contradiction with pattern
-   * placed in (y,x). If wave.get(y, x, pattern) is set to false, then
-   * compatible.get(y, x, pattern) has every element negative or null
+   * placed in cell. These counts are kept exact even after wave.get(cell,
+   * pattern) is set to false, so they are never negative.
+   * The counts are stored in the narrowest unsigned integer type that can
+   * contain the size of the biggest list in the propagator state, and in the
+   * order given by layout.
+   */
+  template <typename Counter>
+  using CompatibleArray = std::vector<Counter, AlignedAllocator<Counter, 64>>;
+  std::variant<CompatibleArray<uint8_t>, CompatibleArray<uint16_t>,
+               CompatibleArray<uint32_t>>
+      compatible;
+
+  /**
+   * The order of the counts in compatible.
+   */
+  const CompatibleLayout layout;
+
+  /**
+   * Allocate compatible with the narrowest counter type.
+   * compatible is empty with the bitsets engine.
+   */
+  static decltype(compatible)
+  make_compatible(unsigned wave_height, unsigned wave_width,
+                  const Model &model, PropagationEngine engine) noexcept;
+
+  /**
+   * The number of 64-bit words of the bitset of a cell in the wave.
+   */
+  const unsigned nb_words;
+
+  /**
+   * With the bitsets engine, the bitset of the patterns that can be placed
+   * next to pattern in the direction direction is stored in the nb_words words
+   * starting at masks[(pattern * 4 + direction) * nb_words]. The masks are
+   * owned by the model.
+   */
+  const uint64_t *masks;
+
+  /**
+   * With the bitsets engine, the cells where patterns were removed, and that
+   * should be propagated. is_propagating[cell] is true if cell is in this
+   * list.
    */
-  Array3D<std::array<int, 4>> compatible;
+  std::vector<unsigned> propagating_cells;
+  std::vector<uint8_t> is_propagating;
+
+  /**
+   * The largest size of the queue and the time spent propagating, if
+   * FAST_WFC_ENABLE_STATS is defined.
+   */
+  WFCStats stats;
+
+  /**
+   * Add a cell to propagating_cells, if it is not already in it.
+   */
+  void add_cell_to_propagator(unsigned cell) noexcept {
+    if (!is_propagating[cell]) {
+      is_propagating[cell] = 1;
+      propagating_cells.push_back(cell);
+      FAST_WFC_STATS(stats.max_queue_size = std::max<uint64_t>(
+                         stats.max_queue_size, propagating_cells.size());)
+    }
+  }
+
+  /**
+   * Propagate the information given with add_to_propagator with the bitsets
+   * engine, stopping after max_elements cells or on a contradiction. Return
+   * the number of cells propagated.
+   */
+  std::size_t propagate_bitsets(Wave &wave, std::size_t max_elements) noexcept;
+
+  /**
+   * Return the position in compatible of the count of (cell, pattern,
+   * direction).
+   */
+  template <CompatibleLayout Layout>
+  std::size_t get_compatible_index(std::size_t cell, std::size_t pattern,
+                                   unsigned direction) const noexcept {
+    if (Layout == CompatibleLayout::pattern_major) {
+      return (cell * patterns_size + pattern) * 4 + direction;
+    } else {
+      return (cell * 4 + direction) * patterns_size + pattern;
+    }
+  }
 
   /**
    * Initialize compatible.
    */
   void init_compatible() noexcept;
 
+  /**
+   * Initialize compatible, stored with Counter and in the order Layout.
+   */
+  template <CompatibleLayout Layout, typename Counter, typename Index>
+  void init_compatible(CompatibleArray<Counter> &compatible,
+                       const AdjacencyTable<Index> &adjacency) noexcept;
+
+  /**
+   * Propagate the information given with add_to_propagator, with compatible
+   * stored with Counter and in the order Layout, and the adjacency table
+   * indexed with Index, stopping after max_elements elements or on a
+   * contradiction. Return the number of elements propagated.
+   */
+  template <CompatibleLayout Layout, typename Counter, typename Index>
+  std::size_t propagate(Wave &wave, CompatibleArray<Counter> &compatible,
+                        const AdjacencyTable<Index> &adjacency,
+                        std::size_t max_elements) noexcept;
+
+  /**
+   * Decrease (or increase if increment is true) the counts of the neighbors of
+   * cell (y, x) that are compatible with pattern, without removing anything
+   * from the wave.
+   */
+  void update_counts(unsigned y, unsigned x, unsigned pattern,
+                     bool increment) noexcept;
+
+  /**
+   * Update the counts of the neighbors of cell (y, x), with compatible stored
+   * with Counter and in the order Layout, and the adjacency table indexed with
+   * Index.
+   */
+  template <CompatibleLayout Layout, typename Counter, typename Index>
+  void update_counts(CompatibleArray<Counter> &compatible,
+                     const AdjacencyTable<Index> &adjacency, unsigned y,
+                     unsigned x, unsigned pattern, bool increment) noexcept;
+
 public:
   /**
    * Constructor building the propagator and initializing compatible.
    */
-  Propagator(unsigned wave_height, unsigned wave_width, bool periodic_output,
-             PropagatorState propagator_state) noexcept
-      : patterns_size(propagator_state.size()),
-        propagator_state(propagator_state), wave_width(wave_width),
-        wave_height(wave_height), periodic_output(periodic_output),
-        compatible(wave_height, wave_width, patterns_size) {
-    init_compatible();
+  Propagator(
+      unsigned wave_height, unsigned wave_width, bool periodic_output,
+      std::shared_ptr<const Model> model,
+      CompatibleLayout layout = CompatibleLayout::direction_major,
+      PropagationEngine engine = PropagationEngine::automatic) noexcept;
+
+  /**
+   * Copy the counts and the elements to propagate of other, a propagator
+   * built with the same arguments.
+   */
+  void copy_state(const Propagator &other) noexcept {
+    propagating = other.propagating;
+    compatible = other.compatible;
+    propagating_cells = other.propagating_cells;
+    is_propagating = other.is_propagating;
   }
 
   /**
@@ -78,16 +246,72 @@ public:
    * This function is called when wave.get(y, x, pattern) is set to false.
    */
   void add_to_propagator(unsigned y, unsigned x, unsigned pattern) noexcept {
-    // All the direction are set to 0, since the pattern cannot be set in (y,x).
-    std::array<int, 4> temp = {};
-    compatible.get(y, x, pattern) = temp;
-    propagating.emplace_back(y, x, pattern);
+    if (engine == PropagationEngine::counters) {
+      propagating.emplace_back(y, x, pattern);
+      FAST_WFC_STATS(stats.max_queue_size = std::max<uint64_t>(
+                         stats.max_queue_size, propagating.size());)
+    } else {
+      // With bitsets, the whole cell is propagated at once.
+      add_cell_to_propagator(y * wave_width + x);
+    }
+  }
+
+  /**
+   * Return the statistics of the propagator since its construction.
+   */
+  const WFCStats &get_stats() const noexcept { return stats; }
+
+  /**
+   * Return the engine used by the propagator.
+   */
+  PropagationEngine get_engine() const noexcept { return engine; }
+
+  /**
+   * Propagate the information given with add_to_propagator, stopping after
+   * max_elements elements (cells with the bitsets engine), which is decreased
+   * by the number of elements propagated. The propagation can be resumed with
+   * another call.
+   * The propagation also stops as soon as a cell has no pattern left, since
+   * the rest of the cascade is useless. The remaining elements are kept, so
+   * clear still restores exact counts.
+   */
+  PropagationStatus propagate(Wave &wave, std::size_t &max_elements) noexcept;
+
+  /**
+   * Propagate every element given with add_to_propagator, or stop on a
+   * contradiction.
+   */
+  PropagationStatus propagate(Wave &wave) noexcept {
+    std::size_t max_elements = std::numeric_limits<std::size_t>::max();
+    return propagate(wave, max_elements);
   }
 
   /**
-   * Propagate the information given with add_to_propagator.
+   * Return true if every element given with add_to_propagator was
+   * propagated.
    */
-  void propagate(Wave &wave) noexcept;
+  bool is_empty() const noexcept {
+    return propagating.empty() && propagating_cells.empty();
+  }
+
+  /**
+   * Drop the elements given with add_to_propagator that are not propagated
+   * yet. Their removal is still taken into account in the counts, so every
+   * pattern removed from the wave can then be restored with restore.
+   */
+  void clear() noexcept;
+
+  /**
+   * Undo the propagation of the removal of pattern from cell (y, x).
+   * This function is called when wave.get(y, x, pattern) is set back to true,
+   * in the reverse order of the removals.
+   */
+  void restore(unsigned y, unsigned x, unsigned pattern) noexcept {
+    // With bitsets, the wave is the only state of the propagation.
+    if (engine == PropagationEngine::counters) {
+      update_counts(y, x, pattern, true);
+    }
+  }
 };
 
 #endif // FAST_WFC_PROPAGATOR_HPP_
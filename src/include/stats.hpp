@@ -0,0 +1,79 @@
+#ifndef FAST_WFC_STATS_HPP_
+#define FAST_WFC_STATS_HPP_
+
+#include <algorithm>
+#include <chrono>
+#include <cstdint>
+
+/**
+ * FAST_WFC_STATS(statement) compiles statement only when the library is built
+ * with the FAST_WFC_ENABLE_STATS option, so the instrumentation costs nothing
+ * otherwise.
+ * Some of it is in inline and template code of the headers, so the programs
+ * using the library should get the define from the fastwfc targets, which
+ * export it, instead of passing it themselves.
+ */
+#ifdef FAST_WFC_ENABLE_STATS
+#define FAST_WFC_STATS(statement) statement
+#else
+#define FAST_WFC_STATS(statement)
+#endif
+
+/**
+ * Counters and timers of the hot paths of the algorithm.
+ * They are only updated when FAST_WFC_ENABLE_STATS is defined, and are all 0
+ * otherwise. The layout does not depend on the option.
+ */
+struct WFCStats {
+  uint64_t nb_observations = 0;   // The number of cells decided by observe.
+  uint64_t nb_removals = 0;       // The number of patterns removed.
+  uint64_t max_queue_size = 0;    // The largest size of the propagation queue.
+  uint64_t nb_contradictions = 0; // The number of contradictions reached.
+  uint64_t nb_log_calls = 0;      // The number of log() computed by Wave.
+
+  // The time spent in Wave::get_min_entropy and Propagator::propagate.
+  std::chrono::nanoseconds min_entropy_time{0};
+  std::chrono::nanoseconds propagation_time{0};
+
+  // The time spent extracting the patterns of an input, and computing which
+  // patterns are compatible (generate_compatible).
+  std::chrono::nanoseconds pattern_extraction_time{0};
+  std::chrono::nanoseconds compatible_generation_time{0};
+
+  /**
+   * Add the counters and timers of other, and keep the largest queue size.
+   */
+  WFCStats &operator+=(const WFCStats &other) noexcept {
+    nb_observations += other.nb_observations;
+    nb_removals += other.nb_removals;
+    max_queue_size = std::max(max_queue_size, other.max_queue_size);
+    nb_contradictions += other.nb_contradictions;
+    nb_log_calls += other.nb_log_calls;
+    min_entropy_time += other.min_entropy_time;
+    propagation_time += other.propagation_time;
+    pattern_extraction_time += other.pattern_extraction_time;
+    compatible_generation_time += other.compatible_generation_time;
+    return *this;
+  }
+};
+
+/**
+ * Add the time between its construction and its destruction to a timer of
+ * WFCStats.
+ */
+class ScopedTimer {
+private:
+  std::chrono::nanoseconds &total;
+  const std::chrono::steady_clock::time_point start;
+
+public:
+  explicit ScopedTimer(std::chrono::nanoseconds &total) noexcept
+      : total(total), start(std::chrono::steady_clock::now()) {}
+
+  ~ScopedTimer() noexcept { total += std::chrono::steady_clock::now() - start; }
+
+  ScopedTimer(const ScopedTimer &) = delete;
+  ScopedTimer &operator=(const ScopedTimer &) = delete;
+};
+
+#endif // FAST_WFC_STATS_HPP_
@@ -1,6 +1,10 @@
 #ifndef FAST_WFC_TILING_WFC_HPP_
 #define FAST_WFC_TILING_WFC_HPP_
 
+#include <algorithm>
+#include <array>
+#include <limits>
+#include <memory>
 #include <unordered_map>
 #include <vector>
 
@@ -158,7 +162,7 @@ template <typename T> struct Tile {
    * weight on the distribution of tiles.
    */
   Tile(std::vector<Array2D<T>> data, Symmetry symmetry, double weight) noexcept
-      : data(data), symmetry(symmetry), weight(weight) {}
+      : data(std::move(data)), symmetry(symmetry), weight(weight) {}
 
   /*
    * Create a tile with its base orientation, its symmetries and its
@@ -166,7 +170,7 @@ template <typename T> struct Tile {
    * The other orientations are generated with its first one.
    */
   Tile(Array2D<T> data, Symmetry symmetry, double weight) noexcept
-      : data(generate_oriented(data, symmetry)), symmetry(symmetry),
+      : data(generate_oriented(std::move(data), symmetry)), symmetry(symmetry),
         weight(weight) {}
 };
 
@@ -175,52 +179,17 @@ template <typename T> struct Tile {
  */
 struct TilingWFCOptions {
   bool periodic_output;
+  WFCOptions wfc_options = {}; // The options of the underlying generic wfc.
 };
 
 /**
- * Class generating a new image with the tiling WFC algorithm.
+ * The model of a tiling WFC problem: the oriented tiles, and the compiled rules
+ * saying which oriented tiles can be placed next to each other.
+ * It does not depend on the output, so it can be shared by every TilingWFC
+ * built from the same tiles and neighbors, on any number of threads.
  */
-template <typename T> class TilingWFC {
-private:
-  /**
-   * The distincts tiles.
-   */
-  std::vector<Tile<T>> tiles;
-
-  /**
-   * Map ids of oriented tiles to tile and orientation.
-   */
-  std::vector<std::pair<unsigned, unsigned>> id_to_oriented_tile;
-
-  /**
-   * Map tile and orientation to oriented tile id.
-   */
-  std::vector<std::vector<unsigned>> oriented_tile_ids;
-
-  /**
-   * Otions needed to use the tiling wfc.
-   */
-  TilingWFCOptions options;
-
-  /**
-   * The underlying generic WFC algorithm.
-   */
-  WFC wfc;
-
-public:
-
-  /**
-   * The number of vertical tiles
-   */
-  unsigned height;
-
-  /**
-   * The number of horizontal tiles
-   */
-  unsigned width;
-
+template <typename T> class TilingModel {
 private:
-
   /**
    * Generate mapping from id to oriented tiles and vice versa.
    */
@@ -245,29 +214,34 @@ private:
 
   /**
    * Generate the propagator which will be used in the wfc algorithm.
+   * Every neighbor rule gives 16 pairs of compatible oriented tiles, which are
+   * appended to the lists, then sorted and deduplicated, so the time and the
+   * memory are linear in the number of rules instead of quadratic in the
+   * number of oriented tiles.
    */
-  static std::vector<std::array<std::vector<unsigned>, 4>> generate_propagator(
+  static Model::PropagatorState generate_propagator(
       const std::vector<std::tuple<unsigned, unsigned, unsigned, unsigned>>
           &neighbors,
-      std::vector<Tile<T>> tiles,
-      std::vector<std::pair<unsigned, unsigned>> id_to_oriented_tile,
-      std::vector<std::vector<unsigned>> oriented_tile_ids) {
-    size_t nb_oriented_tiles = id_to_oriented_tile.size();
-    std::vector<std::array<std::vector<bool>, 4>> dense_propagator(
-        nb_oriented_tiles, {std::vector<bool>(nb_oriented_tiles, false),
-                            std::vector<bool>(nb_oriented_tiles, false),
-                            std::vector<bool>(nb_oriented_tiles, false),
-                            std::vector<bool>(nb_oriented_tiles, false)});
-
-    for (auto neighbor : neighbors) {
+      const std::vector<Tile<T>> &tiles, std::size_t nb_oriented_tiles,
+      const std::vector<std::vector<unsigned>> &oriented_tile_ids) {
+    // The action maps only depend on the symmetry, so there is one for each of
+    // the 6 symmetries.
+    std::array<std::vector<std::vector<unsigned>>, 6> action_maps;
+    for (unsigned symmetry = 0; symmetry < action_maps.size(); symmetry++) {
+      action_maps[symmetry] =
+          Tile<T>::generate_action_map(static_cast<Symmetry>(symmetry));
+    }
+
+    Model::PropagatorState propagator(nb_oriented_tiles);
+    for (const auto &neighbor : neighbors) {
       unsigned tile1 = std::get<0>(neighbor);
       unsigned orientation1 = std::get<1>(neighbor);
       unsigned tile2 = std::get<2>(neighbor);
       unsigned orientation2 = std::get<3>(neighbor);
-      std::vector<std::vector<unsigned>> action_map1 =
-          Tile<T>::generate_action_map(tiles[tile1].symmetry);
-      std::vector<std::vector<unsigned>> action_map2 =
-          Tile<T>::generate_action_map(tiles[tile2].symmetry);
+      const std::vector<std::vector<unsigned>> &action_map1 =
+          action_maps[static_cast<unsigned>(tiles[tile1].symmetry)];
+      const std::vector<std::vector<unsigned>> &action_map2 =
+          action_maps[static_cast<unsigned>(tiles[tile2].symmetry)];
 
       auto add = [&](unsigned action, unsigned direction) {
         unsigned temp_orientation1 = action_map1[action][orientation1];
@@ -276,11 +250,9 @@ private:
             oriented_tile_ids[tile1][temp_orientation1];
         unsigned oriented_tile_id2 =
             oriented_tile_ids[tile2][temp_orientation2];
-        dense_propagator[oriented_tile_id1][direction][oriented_tile_id2] =
-            true;
+        propagator[oriented_tile_id1][direction].push_back(oriented_tile_id2);
         direction = get_opposite_direction(direction);
-        dense_propagator[oriented_tile_id2][direction][oriented_tile_id1] =
-            true;
+        propagator[oriented_tile_id2][direction].push_back(oriented_tile_id1);
       };
 
       add(0, 2);
@@ -293,15 +265,13 @@ private:
       add(7, 0);
     }
 
-    std::vector<std::array<std::vector<unsigned>, 4>> propagator(
-        nb_oriented_tiles);
-    for (size_t i = 0; i < nb_oriented_tiles; ++i) {
-      for (size_t j = 0; j < nb_oriented_tiles; ++j) {
-        for (size_t d = 0; d < 4; ++d) {
-          if (dense_propagator[i][d][j]) {
-            propagator[i][d].push_back(j);
-          }
-        }
+    // The same pair is often given by several rules, or by several actions of
+    // a symmetric tile.
+    for (std::array<std::vector<unsigned>, 4> &lists : propagator) {
+      for (std::vector<unsigned> &list : lists) {
+        std::sort(list.begin(), list.end());
+        list.erase(std::unique(list.begin(), list.end()), list.end());
+        list.shrink_to_fit();
       }
     }
 
@@ -322,16 +292,102 @@ private:
     return frequencies;
   }
 
+public:
+  /**
+   * The distincts tiles.
+   */
+  const std::vector<Tile<T>> tiles;
+
+  /**
+   * Map ids of oriented tiles to tile and orientation.
+   */
+  const std::vector<std::pair<unsigned, unsigned>> id_to_oriented_tile;
+
+  /**
+   * Map tile and orientation to oriented tile id.
+   */
+  const std::vector<std::vector<unsigned>> oriented_tile_ids;
+
+  /**
+   * The weights of the oriented tiles and the compiled rules, used by the
+   * underlying generic WFC algorithm.
+   */
+  const std::shared_ptr<const Model> wfc_model;
+
+  /**
+   * Build the oriented tiles and compile the rules.
+   */
+  TilingModel(
+      const std::vector<Tile<T>> &tiles,
+      const std::vector<std::tuple<unsigned, unsigned, unsigned, unsigned>>
+          &neighbors)
+      : TilingModel(tiles, neighbors, generate_oriented_tile_ids(tiles)) {}
+
+private:
+  /**
+   * Constructor used only to generate the ids of the oriented tiles once.
+   */
+  TilingModel(
+      const std::vector<Tile<T>> &tiles,
+      const std::vector<std::tuple<unsigned, unsigned, unsigned, unsigned>>
+          &neighbors,
+      std::pair<std::vector<std::pair<unsigned, unsigned>>,
+                std::vector<std::vector<unsigned>>> &&ids)
+      : tiles(tiles), id_to_oriented_tile(std::move(ids.first)),
+        oriented_tile_ids(std::move(ids.second)),
+        wfc_model(std::make_shared<const Model>(
+            get_tiles_weights(tiles),
+            generate_propagator(neighbors, this->tiles,
+                                id_to_oriented_tile.size(),
+                                oriented_tile_ids))) {}
+};
+
+/**
+ * Class generating a new image with the tiling WFC algorithm.
+ */
+template <typename T> class TilingWFC {
+private:
+  /**
+   * The tiles and the rules, shared with the other instances built from the
+   * same model.
+   */
+  std::shared_ptr<const TilingModel<T>> model;
+
+  /**
+   * Otions needed to use the tiling wfc.
+   */
+  TilingWFCOptions options;
+
+  /**
+   * The underlying generic WFC algorithm.
+   */
+  WFC wfc;
+
+public:
+
+  /**
+   * The number of vertical tiles
+   */
+  unsigned height;
+
+  /**
+   * The number of horizontal tiles
+   */
+  unsigned width;
+
+private:
+
   /**
    * Translate the generic WFC result into the image result
    */
-  Array2D<T> id_to_tiling(Array2D<unsigned> ids) {
+  Array2D<T> id_to_tiling(const Array2D<unsigned> &ids) const {
+    const std::vector<Tile<T>> &tiles = model->tiles;
     unsigned size = tiles[0].data[0].height;
     Array2D<T> tiling(size * ids.height, size * ids.width);
     for (unsigned i = 0; i < ids.height; i++) {
       for (unsigned j = 0; j < ids.width; j++) {
         std::pair<unsigned, unsigned> oriented_tile =
-            id_to_oriented_tile[ids.get(i, j)];
+            model->id_to_oriented_tile[ids.get(i, j)];
         for (unsigned y = 0; y < size; y++) {
           for (unsigned x = 0; x < size; x++) {
             tiling.get(i * size + y, j * size + x) =
@@ -344,7 +400,7 @@ private:
   }
 
   void set_tile(unsigned tile_id, unsigned i, unsigned j) noexcept {
-    for (unsigned p = 0; p < id_to_oriented_tile.size(); p++) {
+    for (unsigned p = 0; p < model->id_to_oriented_tile.size(); p++) {
       if (tile_id != p) {
         wfc.remove_wave_pattern(i, j, p);
       }
@@ -361,41 +417,91 @@ public:
           &neighbors,
       const unsigned height, const unsigned width,
       const TilingWFCOptions &options, int seed)
-      : tiles(tiles),
-        id_to_oriented_tile(generate_oriented_tile_ids(tiles).first),
-        oriented_tile_ids(generate_oriented_tile_ids(tiles).second),
-        options(options),
-        wfc(options.periodic_output, seed, get_tiles_weights(tiles),
-            generate_propagator(neighbors, tiles, id_to_oriented_tile,
-                                oriented_tile_ids),
-            height, width),
+      : TilingWFC(std::make_shared<const TilingModel<T>>(tiles, neighbors),
+                  height, width, options, seed) {}
+
+  /**
+   * Construct the TilingWFC class with a model, which can be shared with
+   * other instances. Only the state of the run is allocated.
+   */
+  TilingWFC(std::shared_ptr<const TilingModel<T>> model, const unsigned height,
+            const unsigned width, const TilingWFCOptions &options, int seed)
+      : model(std::move(model)), options(options),
+        wfc(options.periodic_output, seed, this->model->wfc_model, height,
+            width, options.wfc_options),
         height(height), width(width) {}
 
   /**
-   * Set the tile at a specific position.
+   * Set the tile at a specific position, and propagate it.
    * Returns false if the given tile and orientation does not exist,
-   * or if the coordinates are not in the wave
+   * if the coordinates are not in the wave, or if the tile leads to a
+   * contradiction
    */
   bool set_tile(unsigned tile_id, unsigned orientation, unsigned i, unsigned j) noexcept {
+    const std::vector<std::vector<unsigned>> &oriented_tile_ids =
+        model->oriented_tile_ids;
     if (tile_id >= oriented_tile_ids.size() || orientation >= oriented_tile_ids[tile_id].size() || i >= height || j >= width) {
       return false;
     }
 
     unsigned oriented_tile_id = oriented_tile_ids[tile_id][orientation];
     set_tile(oriented_tile_id, i, j);
-    return true;
+    return wfc.propagate();
+  }
+
+  /**
+   * Return the current state of the algorithm, for instance after the
+   * constraints have been set.
+   */
+  WFC::Snapshot snapshot() const noexcept { return wfc.snapshot(); }
+
+  /**
+   * Go back to a state returned by snapshot, and reseed the algorithm. This
+   * is much cheaper than building a new object with the new seed.
+   */
+  void restore(const WFC::Snapshot &snapshot, int seed) noexcept {
+    wfc.restore(snapshot, seed);
   }
 
   /**
    * Run the tiling wfc and return the result if the algorithm succeeded
    */
   std::optional<Array2D<T>> run() {
-    auto a = wfc.run();
-    if (a == std::nullopt) {
+    if (wfc.step(std::numeric_limits<std::size_t>::max()) != WFC::success) {
       return std::nullopt;
     }
-    return id_to_tiling(*a);
+    return id_to_tiling(wfc.get_output());
+  }
+
+  /**
+   * Return the statistics of the algorithm since its construction. See
+   * WFC::get_stats.
+   */
+  WFCStats get_stats() const noexcept { return wfc.get_stats(); }
+
+  /**
+   * Run the algorithm from where it stopped for about budget, so it can be
+   * spread over several frames. Once it returns WFC::success, run returns the
+   * result immediately. See WFC::run_for.
+   */
+  WFC::ObserveStatus run_for(std::chrono::nanoseconds budget) noexcept {
+    return wfc.run_for(budget);
+  }
+
+  /**
+   * Run the algorithm from the current state with every seed of seeds, on
+   * n_threads threads, and return the first seed of the list that succeeded
+   * with its result. See WFC::run_parallel.
+   */
+  std::optional<std::pair<int, Array2D<T>>>
+  run_parallel(unsigned n_threads, const std::vector<int> &seeds) const {
+    auto result = wfc.run_parallel(n_threads, seeds);
+    if (!result.has_value()) {
+      return std::nullopt;
+    }
+    return std::make_pair(result->first, id_to_tiling(result->second));
   }
 };
 
 #endif // FAST_WFC_TILING_WFC_HPP_
+
@@ -0,0 +1,44 @@
+#ifndef FAST_WFC_UTILS_ALIGNED_ALLOCATOR_HPP_
+#define FAST_WFC_UTILS_ALIGNED_ALLOCATOR_HPP_
+
+#include <cstddef>
+#include <new>
+
+/**
+ * Allocator returning memory aligned on Alignment bytes.
+ * This is used to align the start of large arrays on a cache line.
+ */
+template <typename T, std::size_t Alignment> class AlignedAllocator {
+public:
+  using value_type = T;
+
+  template <typename U> struct rebind {
+    using other = AlignedAllocator<U, Alignment>;
+  };
+
+  AlignedAllocator() noexcept = default;
+
+  template <typename U>
+  AlignedAllocator(const AlignedAllocator<U, Alignment> &) noexcept {}
+
+  T *allocate(std::size_t n) {
+    return static_cast<T *>(
+        ::operator new(n * sizeof(T), std::align_val_t(Alignment)));
+  }
+
+  void deallocate(T *p, std::size_t) noexcept {
+    ::operator delete(p, std::align_val_t(Alignment));
+  }
+
+  template <typename U>
+  bool operator==(const AlignedAllocator<U, Alignment> &) const noexcept {
+    return true;
+  }
+
+  template <typename U>
+  bool operator!=(const AlignedAllocator<U, Alignment> &) const noexcept {
+    return false;
+  }
+};
+
+#endif // FAST_WFC_UTILS_ALIGNED_ALLOCATOR_HPP_
@@ -0,0 +1,35 @@
+#ifndef FAST_WFC_UTILS_BIT_OPERATIONS_HPP_
+#define FAST_WFC_UTILS_BIT_OPERATIONS_HPP_
+
+#include <cstdint>
+
+#ifdef _MSC_VER
+#include <intrin.h>
+#endif
+
+/**
+ * Return the number of bits set to 1 in word.
+ */
+inline unsigned popcount(uint64_t word) noexcept {
+#ifdef _MSC_VER
+  return static_cast<unsigned>(__popcnt64(word));
+#else
+  return static_cast<unsigned>(__builtin_popcountll(word));
+#endif
+}
+
+/**
+ * Return the index of the lowest bit set to 1 in word.
+ * word should not be equal to 0.
+ */
+inline unsigned count_trailing_zeros(uint64_t word) noexcept {
+#ifdef _MSC_VER
+  unsigned long index;
+  _BitScanForward64(&index, word);
+  return static_cast<unsigned>(index);
+#else
+  return static_cast<unsigned>(__builtin_ctzll(word));
+#endif
+}
+
+#endif // FAST_WFC_UTILS_BIT_OPERATIONS_HPP_
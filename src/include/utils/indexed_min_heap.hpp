@@ -0,0 +1,164 @@
+#ifndef FAST_WFC_UTILS_INDEXED_MIN_HEAP_HPP_
+#define FAST_WFC_UTILS_INDEXED_MIN_HEAP_HPP_
+
+#include "assert.h"
+#include <limits>
+#include <vector>
+
+/**
+ * Represent a binary min-heap over the elements [0, capacity).
+ * Every element of the heap has a key, and the element with the lowest key is
+ * on top. Contrary to std::priority_queue, the heap knows where each element
+ * is stored, so the key of an element can be changed, and an element can be
+ * removed, in O(log(n)).
+ */
+template <typename Key> class IndexedMinHeap {
+
+private:
+  /**
+   * Position of an element that is not in the heap.
+   */
+  static constexpr unsigned npos = std::numeric_limits<unsigned>::max();
+
+  /**
+   * The elements in the heap, ordered as a binary heap on their keys.
+   */
+  std::vector<unsigned> heap;
+
+  /**
+   * position[element] is the index of element in heap, or npos if element is
+   * not in the heap.
+   */
+  std::vector<unsigned> position;
+
+  /**
+   * keys[element] is the key of element. This is only meaningful if the
+   * element is in the heap.
+   */
+  std::vector<Key> keys;
+
+  /**
+   * Place the element at index i in heap, and update its position.
+   */
+  void place(unsigned i, unsigned element) noexcept {
+    heap[i] = element;
+    position[element] = i;
+  }
+
+  /**
+   * Move the element at index i up until the heap property is restored.
+   */
+  void sift_up(unsigned i) noexcept {
+    unsigned element = heap[i];
+    while (i > 0) {
+      unsigned parent = (i - 1) / 2;
+      if (!(keys[element] < keys[heap[parent]])) {
+        break;
+      }
+      place(i, heap[parent]);
+      i = parent;
+    }
+    place(i, element);
+  }
+
+  /**
+   * Move the element at index i down until the heap property is restored.
+   */
+  void sift_down(unsigned i) noexcept {
+    unsigned element = heap[i];
+    unsigned size = static_cast<unsigned>(heap.size());
+    while (true) {
+      unsigned child = 2 * i + 1;
+      if (child >= size) {
+        break;
+      }
+      if (child + 1 < size && keys[heap[child + 1]] < keys[heap[child]]) {
+        child++;
+      }
+      if (!(keys[heap[child]] < keys[element])) {
+        break;
+      }
+      place(i, heap[child]);
+      i = child;
+    }
+    place(i, element);
+  }
+
+public:
+  /**
+   * Build an empty heap that can contain the elements [0, capacity).
+   */
+  IndexedMinHeap(std::size_t capacity) noexcept
+      : position(capacity, npos), keys(capacity) {
+    heap.reserve(capacity);
+  }
+
+  /**
+   * Return true if there is no element in the heap.
+   */
+  bool empty() const noexcept { return heap.empty(); }
+
+  /**
+   * Return true if element is in the heap.
+   */
+  bool contains(unsigned element) const noexcept {
+    return position[element] != npos;
+  }
+
+  /**
+   * Return the element with the lowest key.
+   * The heap should not be empty.
+   */
+  unsigned top() const noexcept {
+    assert(!empty());
+    return heap[0];
+  }
+
+  /**
+   * Insert element with the given key, or change its key if it is already in
+   * the heap.
+   */
+  void push(unsigned element, Key key) noexcept {
+    if (!contains(element)) {
+      keys[element] = key;
+      heap.push_back(element);
+      sift_up(static_cast<unsigned>(heap.size() - 1));
+      return;
+    }
+
+    Key old_key = keys[element];
+    keys[element] = key;
+    if (key < old_key) {
+      sift_up(position[element]);
+    } else {
+      sift_down(position[element]);
+    }
+  }
+
+  /**
+   * Remove element from the heap, if it is present.
+   */
+  void remove(unsigned element) noexcept {
+    if (!contains(element)) {
+      return;
+    }
+    unsigned i = position[element];
+    unsigned last = heap.back();
+    heap.pop_back();
+    position[element] = npos;
+    if (last == element) {
+      return;
+    }
+
+    // The last element takes the place of the removed one, and is moved to
+    // restore the heap property.
+    place(i, last);
+    if (i > 0 && keys[last] < keys[heap[(i - 1) / 2]]) {
+      sift_up(i);
+    } else {
+      sift_down(i);
+    }
+  }
+};
+
+#endif // FAST_WFC_UTILS_INDEXED_MIN_HEAP_HPP_
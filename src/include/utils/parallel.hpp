@@ -0,0 +1,57 @@
+#ifndef FAST_WFC_UTILS_PARALLEL_HPP_
+#define FAST_WFC_UTILS_PARALLEL_HPP_
+
+#include <algorithm>
+#include <atomic>
+#include <cstddef>
+#include <thread>
+#include <vector>
+
+/**
+ * Return the number of threads to use when n_threads are asked, 0 meaning as
+ * many threads as the hardware supports.
+ */
+inline unsigned get_nb_threads(unsigned n_threads) noexcept {
+  if (n_threads == 0) {
+    n_threads = std::max(1u, std::thread::hardware_concurrency());
+  }
+  return n_threads;
+}
+
+/**
+ * Call f(i) for every i in [0, n), on n_threads threads (0 meaning as many
+ * threads as the hardware supports).
+ * Every thread repeatedly takes the lowest index not taken yet, so the indices
+ * are started in increasing order, and slow calls do not delay the others.
+ * With one thread, everything is done on the calling thread.
+ */
+template <typename F>
+void parallel_for(unsigned n_threads, std::size_t n, F &&f) {
+  n_threads = static_cast<unsigned>(
+      std::min<std::size_t>(get_nb_threads(n_threads), n));
+  if (n_threads <= 1) {
+    for (std::size_t i = 0; i < n; i++) {
+      f(i);
+    }
+    return;
+  }
+
+  std::atomic<std::size_t> next_index(0);
+  auto worker = [&]() {
+    for (std::size_t i = next_index++; i < n; i = next_index++) {
+      f(i);
+    }
+  };
+
+  std::vector<std::thread> threads;
+  threads.reserve(n_threads - 1);
+  for (unsigned t = 1; t < n_threads; t++) {
+    threads.emplace_back(worker);
+  }
+  worker();
+  for (std::thread &thread : threads) {
+    thread.join();
+  }
+}
+
+#endif // FAST_WFC_UTILS_PARALLEL_HPP_
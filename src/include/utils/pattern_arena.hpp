@@ -0,0 +1,192 @@
+#ifndef FAST_WFC_UTILS_PATTERN_ARENA_HPP_
+#define FAST_WFC_UTILS_PATTERN_ARENA_HPP_
+
+#include "aligned_allocator.hpp"
+#include "array2D.hpp"
+#include "assert.h"
+#include <functional>
+#include <limits>
+#include <optional>
+#include <vector>
+
+/**
+ * Represent a set of distinct square patterns of the same size, numbered in
+ * the order in which they were inserted.
+ * The patterns are stored one after the other in a single aligned array, and
+ * are indexed by an open addressing hash table, so the id of a pattern is
+ * found in O(1) on average.
+ */
+template <typename T> class PatternArena {
+
+private:
+  /**
+   * The id of no pattern, in an empty slot of the table.
+   */
+  static constexpr unsigned npos = std::numeric_limits<unsigned>::max();
+
+  /**
+   * The width and height of the patterns, and their number of pixels.
+   */
+  std::size_t pattern_size;
+  std::size_t record_size;
+
+  /**
+   * The pixels of the pattern id, row by row, from id * record_size.
+   */
+  std::vector<T, AlignedAllocator<T, 64>> data;
+
+  /**
+   * The hash of every pattern.
+   */
+  std::vector<std::size_t> hashes;
+
+  /**
+   * The hash table, with linear probing. Its size is a power of 2, and it is
+   * kept at most half full.
+   */
+  std::vector<unsigned> slots;
+
+  /**
+   * Return the hash of the pattern whose pixels start at pixels.
+   */
+  std::size_t get_hash(const T *pixels) const noexcept {
+    std::size_t seed = record_size;
+    for (std::size_t i = 0; i < record_size; i++) {
+      seed ^= std::hash<T>()(pixels[i]) + (std::size_t)0x9e3779b9 +
+              (seed << 6) + (seed >> 2);
+    }
+    return seed;
+  }
+
+  /**
+   * Return the first slot to look at for hash.
+   */
+  std::size_t get_slot(std::size_t hash) const noexcept {
+    return (hash * std::size_t(0x9e3779b97f4a7c15) >> 16) &
+           (slots.size() - 1);
+  }
+
+  /**
+   * Return true if the pattern id has the pixels starting at pixels.
+   */
+  bool is_equal(unsigned id, const T *pixels) const noexcept {
+    const T *record = get(id);
+    for (std::size_t i = 0; i < record_size; i++) {
+      if (record[i] != pixels[i]) {
+        return false;
+      }
+    }
+    return true;
+  }
+
+  /**
+   * Return the slot of the pattern with the given pixels and hash, or the
+   * empty slot where it would be inserted.
+   */
+  std::size_t find_slot(const T *pixels, std::size_t hash) const noexcept {
+    std::size_t slot = get_slot(hash);
+    while (slots[slot] != npos &&
+           !(hashes[slots[slot]] == hash && is_equal(slots[slot], pixels))) {
+      slot = (slot + 1) & (slots.size() - 1);
+    }
+    return slot;
+  }
+
+public:
+  /**
+   * Build an empty set of patterns of size pattern_size * pattern_size.
+   */
+  explicit PatternArena(std::size_t pattern_size) noexcept
+      : pattern_size(pattern_size), record_size(pattern_size * pattern_size),
+        slots(16, npos) {}
+
+  /**
+   * Return the number of patterns.
+   */
+  std::size_t size() const noexcept { return hashes.size(); }
+
+  /**
+   * Return the width and height of the patterns.
+   */
+  std::size_t get_pattern_size() const noexcept { return pattern_size; }
+
+  /**
+   * Return the pixels of the pattern id, row by row.
+   */
+  const T *get(unsigned id) const noexcept {
+    assert(id < size());
+    return &data[id * record_size];
+  }
+
+  /**
+   * Return the pixel in the y-th line and x-th column of the pattern id.
+   */
+  const T &get(unsigned id, std::size_t y, std::size_t x) const noexcept {
+    assert(y < pattern_size && x < pattern_size);
+    return get(id)[y * pattern_size + x];
+  }
+
+  /**
+   * Return a copy of the pattern id.
+   */
+  Array2D<T> to_array(unsigned id) const noexcept {
+    Array2D<T> pattern(pattern_size, pattern_size);
+    pattern.data.assign(get(id), get(id) + record_size);
+    return pattern;
+  }
+
+  /**
+   * Reserve the memory needed by nb_patterns patterns.
+   */
+  void reserve(std::size_t nb_patterns) {
+    data.reserve(nb_patterns * record_size);
+    hashes.reserve(nb_patterns);
+  }
+
+  /**
+   * Insert the pattern whose pixels, row by row, start at pixels, if it is
+   * not in the set yet, and return its id.
+   */
+  unsigned insert(const T *pixels) {
+    std::size_t hash = get_hash(pixels);
+    std::size_t slot = find_slot(pixels, hash);
+    if (slots[slot] != npos) {
+      return slots[slot];
+    }
+
+    unsigned id = static_cast<unsigned>(size());
+    data.insert(data.end(), pixels, pixels + record_size);
+    hashes.push_back(hash);
+    if (2 * size() > slots.size()) {
+      // Every pattern is placed again in a table twice as large.
+      slots.assign(2 * slots.size(), npos);
+      for (unsigned other = 0; other <= id; other++) {
+        slot = get_slot(hashes[other]);
+        while (slots[slot] != npos) {
+          slot = (slot + 1) & (slots.size() - 1);
+        }
+        slots[slot] = other;
+      }
+    } else {
+      slots[slot] = id;
+    }
+    return id;
+  }
+
+  /**
+   * Return the id of pattern, or nullopt if it is not in the set.
+   */
+  std::optional<unsigned> find(const Array2D<T> &pattern) const noexcept {
+    if (pattern.height != pattern_size || pattern.width != pattern_size) {
+      return std::nullopt;
+    }
+    const T *pixels = pattern.data.data();
+    unsigned id = slots[find_slot(pixels, get_hash(pixels))];
+    if (id == npos) {
+      return std::nullopt;
+    }
+    return id;
+  }
+};
+
+#endif // FAST_WFC_UTILS_PATTERN_ARENA_HPP_
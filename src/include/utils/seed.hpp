@@ -0,0 +1,31 @@
+#ifndef FAST_WFC_UTILS_SEED_HPP_
+#define FAST_WFC_UTILS_SEED_HPP_
+
+#include <cstdint>
+
+/**
+ * Mix the bits of x (splitmix64 finalizer), so close inputs give unrelated
+ * outputs.
+ */
+inline uint64_t mix_seed_bits(uint64_t x) noexcept {
+  x += 0x9e3779b97f4a7c15;
+  x = (x ^ (x >> 30)) * 0xbf58476d1ce4e5b9;
+  x = (x ^ (x >> 27)) * 0x94d049bb133111eb;
+  return x ^ (x >> 31);
+}
+
+/**
+ * Return the seed of the given attempt to solve the region (y, x) of an
+ * output generated with seed. It only depends on its arguments, so a region
+ * is solved the same way whatever the order in which the regions are solved.
+ */
+inline int get_region_seed(int seed, uint32_t y, uint32_t x,
+                           unsigned attempt) noexcept {
+  uint64_t h = mix_seed_bits(static_cast<uint32_t>(seed));
+  h = mix_seed_bits(h ^ y);
+  h = mix_seed_bits(h ^ x);
+  h = mix_seed_bits(h ^ attempt);
+  return static_cast<int>(h >> 33);
+}
+
+#endif // FAST_WFC_UTILS_SEED_HPP_
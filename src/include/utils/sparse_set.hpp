@@ -0,0 +1,92 @@
+#ifndef FAST_WFC_UTILS_SPARSE_SET_HPP_
+#define FAST_WFC_UTILS_SPARSE_SET_HPP_
+
+#include "assert.h"
+#include <limits>
+#include <vector>
+
+/**
+ * Represent a set of elements of [0, capacity).
+ * The elements are stored contiguously, in no particular order, so they can be
+ * iterated over in O(size()). An element is inserted, removed or looked up in
+ * O(1): a removed element is replaced by the last one.
+ */
+class SparseSet {
+
+private:
+  /**
+   * Position of an element that is not in the set.
+   */
+  static constexpr unsigned npos = std::numeric_limits<unsigned>::max();
+
+  /**
+   * The elements in the set.
+   */
+  std::vector<unsigned> elements;
+
+  /**
+   * position[element] is the index of element in elements, or npos if element
+   * is not in the set.
+   */
+  std::vector<unsigned> position;
+
+public:
+  /**
+   * Build an empty set that can contain the elements [0, capacity).
+   */
+  SparseSet(std::size_t capacity) noexcept : position(capacity, npos) {
+    elements.reserve(capacity);
+  }
+
+  /**
+   * Return the number of elements in the set.
+   */
+  std::size_t size() const noexcept { return elements.size(); }
+
+  /**
+   * Return true if there is no element in the set.
+   */
+  bool empty() const noexcept { return elements.empty(); }
+
+  /**
+   * Return true if element is in the set.
+   */
+  bool contains(unsigned element) const noexcept {
+    return position[element] != npos;
+  }
+
+  /**
+   * Insert element in the set. It should not be in the set already.
+   */
+  void insert(unsigned element) noexcept {
+    assert(!contains(element));
+    position[element] = static_cast<unsigned>(elements.size());
+    elements.push_back(element);
+  }
+
+  /**
+   * Remove element from the set. It should be in the set.
+   */
+  void remove(unsigned element) noexcept {
+    assert(contains(element));
+    unsigned i = position[element];
+    unsigned last = elements.back();
+    elements[i] = last;
+    position[last] = i;
+    elements.pop_back();
+    position[element] = npos;
+  }
+
+  /**
+   * Iterate over the elements of the set. Inserting or removing elements
+   * invalidates the iterators.
+   */
+  std::vector<unsigned>::const_iterator begin() const noexcept {
+    return elements.begin();
+  }
+  std::vector<unsigned>::const_iterator end() const noexcept {
+    return elements.end();
+  }
+};
+
+#endif // FAST_WFC_UTILS_SPARSE_SET_HPP_
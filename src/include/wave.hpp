@@ -1,22 +1,40 @@
 #ifndef FAST_WFC_WAVE_HPP_
 #define FAST_WFC_WAVE_HPP_
 
+#include "model.hpp"
+#include "stats.hpp"
+#include "utils/aligned_allocator.hpp"
 #include "utils/array2D.hpp"
+#include "utils/bit_operations.hpp"
+#include "utils/indexed_min_heap.hpp"
+#include "utils/sparse_set.hpp"
+#include <cmath>
+#include <cstdint>
+#include <memory>
 #include <random>
 #include <vector>
 
 /**
  * Struct containing the values needed to compute the entropy of all the cells.
- * This struct is updated every time the wave is changed.
+ * The sums are updated every time the wave is changed, but the entropy, which
+ * needs a log(), is only computed again when it is read.
  * p'(pattern) is equal to patterns_frequencies[pattern] if wave.get(cell,
  * pattern) is set to true, otherwise 0.
  */
 struct EntropyMemoisation {
   std::vector<double> plogp_sum; // The sum of p'(pattern) * log(p'(pattern)).
   std::vector<double> sum;       // The sum of p'(pattern).
-  std::vector<double> log_sum;   // The log of sum.
   std::vector<unsigned> nb_patterns; // The number of patterns present
   std::vector<double> entropy;       // The entropy of the cell.
+  std::vector<uint8_t> is_outdated;  // True if entropy has to be recomputed.
+};
+
+/**
+ * The way the cell with the lowest entropy is searched in the wave.
+ */
+enum class MinEntropySearch {
+  linear_scan,  // Compute the minimum over all the cells at every call.
+  indexed_heap, // Keep the cells in a heap, updated when their entropy changes.
 };
 
 /**
@@ -26,42 +44,131 @@ struct EntropyMemoisation {
 class Wave {
 private:
   /**
-   * The patterns frequencies p given to wfc.
+   * The model, containing the patterns frequencies p and the precomputation
+   * of p * log(p).
    */
-  const std::vector<double> patterns_frequencies;
+  std::shared_ptr<const Model> model;
 
   /**
-   * The precomputation of p * log(p).
+   * The memoisation of important values for the computation of entropy.
    */
-  const std::vector<double> plogp_patterns_frequencies;
+  EntropyMemoisation memoisation;
 
   /**
-   * The precomputation of min (p * log(p)) / 2.
-   * This is used to define the maximum value of the noise.
+   * The number of cells where every pattern has been removed. There is a
+   * contradiction in the wave if it is not 0.
    */
-  const double min_abs_half_plogp;
+  unsigned nb_impossible_cells;
 
   /**
-   * The memoisation of important values for the computation of entropy.
+   * The number of distinct patterns.
    */
-  EntropyMemoisation memoisation;
+  const size_t nb_patterns;
 
   /**
-   * This value is set to true if there is a contradiction in the wave (all
-   * elements set to false in a cell).
+   * The number of 64-bit words used to store the patterns of a cell.
    */
-  bool is_impossible;
+  const unsigned nb_words;
 
   /**
-   * The number of distinct patterns.
+   * The actual wave, stored as one bitset of nb_words words per cell.
+   * The bit pattern % 64 of the word index * nb_words + pattern / 64 is set if
+   * the pattern can be placed in the cell index. The bits after the last
+   * pattern are always unset.
    */
-  const size_t nb_patterns;
+  std::vector<uint64_t, AlignedAllocator<uint64_t, 64>> data;
+
+  /**
+   * The XOR of the ids of the patterns that can be placed in every cell,
+   * updated in O(1) at every removal. When a single pattern is left in a cell,
+   * it is that pattern, so the output never has to be searched in data.
+   */
+  Array2D<unsigned> patterns_xor;
+
+  /**
+   * The cells where more than one pattern can be placed. A cell leaves the set
+   * when its second to last pattern is removed, and enters it again when a
+   * second pattern is restored, so decided cells are never visited.
+   */
+  SparseSet undecided_cells;
+
+  /**
+   * Update the memoisation and the heap after pattern was removed from the
+   * cell index.
+   */
+  void on_pattern_removed(unsigned index, unsigned pattern) noexcept;
+
+  /**
+   * Update the memoisation and the heap after pattern was added back to the
+   * cell index.
+   */
+  void on_pattern_restored(unsigned index, unsigned pattern) noexcept;
+
+  /**
+   * A removal of a pattern from a cell, recorded in the journal.
+   */
+  struct Removal {
+    unsigned index;
+    unsigned pattern;
+  };
+
+  /**
+   * If true, every removal is recorded in the journal, so it can be undone.
+   */
+  bool journaling;
+
+  /**
+   * The removals done since the journaling started, in order.
+   */
+  std::vector<Removal> journal;
+
+  /**
+   * The way the cell with the lowest entropy is searched.
+   */
+  const MinEntropySearch min_entropy_search;
+
+  /**
+   * The removals, the log() computed and the time spent searching the cell
+   * with lowest entropy, if FAST_WFC_ENABLE_STATS is defined.
+   */
+  WFCStats stats;
+
+  /**
+   * When using the indexed heap, the undecided cells, whose key is their
+   * entropy plus a small noise.
+   * The key of a cell is only updated in get_min_entropy, so the noise is
+   * drawn with the generator given by wfc.
+   */
+  IndexedMinHeap<double> entropy_heap;
+
+  /**
+   * The cells whose entropy has changed since the last call to
+   * get_min_entropy, and is_changed[index] is true if index is in this list.
+   * This is only used with the indexed heap.
+   */
+  std::vector<unsigned> changed_cells;
+  std::vector<uint8_t> is_changed;
+
+  /**
+   * Return the entropy of the cell index, and compute it again if the cell
+   * changed since it was last read. When all the frequencies are equal, it is
+   * read in a table instead.
+   * It is only called in wave.cpp, where it is defined, so it is still
+   * inlined.
+   */
+  double get_entropy(unsigned index) noexcept;
+
+  /**
+   * Return the index of the cell with lowest entropy by looking at every
+   * undecided cell.
+   */
+  int get_min_entropy_linear_scan(std::minstd_rand &gen) noexcept;
 
   /**
-   * The actual wave. data.get(index, pattern) is equal to 0 if the pattern can
-   * be placed in the cell index.
+   * Return the index of the cell with lowest entropy by updating the keys of
+   * the changed cells in the heap.
    */
-  Array2D<uint8_t> data;
+  int get_min_entropy_indexed_heap(std::minstd_rand &gen) noexcept;
 
 public:
   /**
@@ -74,14 +181,23 @@ public:
   /**
    * Initialize the wave with every cell being able to have every pattern.
    */
-  Wave(unsigned height, unsigned width,
-       const std::vector<double> &patterns_frequencies) noexcept;
+  Wave(unsigned height, unsigned width, std::shared_ptr<const Model> model,
+       MinEntropySearch min_entropy_search =
+           MinEntropySearch::indexed_heap) noexcept;
+
+  /**
+   * Copy the patterns, the memoisation and the heap of other, a wave of the
+   * same size built with the same model.
+   * Since the arrays have the same sizes, this is a plain copy of their
+   * contents, without any allocation.
+   */
+  void copy_state(const Wave &other) noexcept;
 
   /**
    * Return true if pattern can be placed in cell index.
    */
   bool get(unsigned index, unsigned pattern) const noexcept {
-    return data.get(index, pattern);
+    return (data[index * nb_words + pattern / 64] >> (pattern % 64)) & 1;
   }
 
   /**
@@ -103,12 +219,138 @@ public:
     set(i * width + j, pattern, value);
   }
 
+  /**
+   * Return the number of patterns that can be placed in cell index.
+   */
+  unsigned count(unsigned index) const noexcept {
+    const uint64_t *words = &data[index * nb_words];
+    unsigned result = 0;
+    for (unsigned w = 0; w < nb_words; w++) {
+      result += popcount(words[w]);
+    }
+    return result;
+  }
+
+  /**
+   * Return the number of cells where more than one pattern can be placed.
+   * The wave is fully decided when it is 0 and is_impossible() is false.
+   */
+  std::size_t get_nb_undecided_cells() const noexcept {
+    return undecided_cells.size();
+  }
+
+  /**
+   * Return the pattern of every cell, without any copy. The value of a cell is
+   * only meaningful when exactly one pattern can be placed in it.
+   */
+  const Array2D<unsigned> &get_decided_patterns() const noexcept {
+    return patterns_xor;
+  }
+
+  /**
+   * Return the first pattern that can be placed in cell index, or the number
+   * of patterns if there is none.
+   */
+  unsigned first(unsigned index) const noexcept {
+    const uint64_t *words = &data[index * nb_words];
+    for (unsigned w = 0; w < nb_words; w++) {
+      if (words[w] != 0) {
+        return w * 64 + count_trailing_zeros(words[w]);
+      }
+    }
+    return static_cast<unsigned>(nb_patterns);
+  }
+
+  /**
+   * Call f(pattern) for every pattern that can be placed in cell index, in
+   * increasing order. f can remove patterns from the cell.
+   */
+  template <typename F> void for_each(unsigned index, F &&f) const {
+    for (unsigned w = 0; w < nb_words; w++) {
+      uint64_t word = data[index * nb_words + w];
+      while (word != 0) {
+        f(w * 64 + count_trailing_zeros(word));
+        word &= word - 1;
+      }
+    }
+  }
+
+  /**
+   * Remove from cell index every pattern that is not in mask, a bitset of
+   * nb_words words. Call removed(pattern) for every removed pattern.
+   */
+  template <typename F>
+  void intersect(unsigned index, const uint64_t *mask, F &&removed) noexcept {
+    for (unsigned w = 0; w < nb_words; w++) {
+      uint64_t &word = data[index * nb_words + w];
+      uint64_t removed_bits = word & ~mask[w];
+      word &= mask[w];
+      while (removed_bits != 0) {
+        unsigned pattern = w * 64 + count_trailing_zeros(removed_bits);
+        on_pattern_removed(index, pattern);
+        removed(pattern);
+        removed_bits &= removed_bits - 1;
+      }
+    }
+  }
+
+  /**
+   * Return the statistics of the wave since its construction.
+   */
+  const WFCStats &get_stats() const noexcept { return stats; }
+
+  /**
+   * Start or stop recording the removals in the journal.
+   */
+  void set_journaling(bool value) noexcept { journaling = value; }
+
+  /**
+   * Forget the removals recorded in the journal. They cannot be undone
+   * anymore.
+   */
+  void clear_journal() noexcept { journal.clear(); }
+
+  /**
+   * Return the number of removals recorded in the journal. This can be used as
+   * a mark to undo every removal done after it.
+   */
+  std::size_t get_journal_size() const noexcept { return journal.size(); }
+
+  /**
+   * Put back every pattern removed since the journal had the size mark, in
+   * the reverse order of the removals. Call restored(index, pattern) for every
+   * pattern put back in cell index.
+   */
+  template <typename F> void undo(std::size_t mark, F &&restored) noexcept {
+    while (journal.size() > mark) {
+      Removal removal = journal.back();
+      journal.pop_back();
+      data[removal.index * nb_words + removal.pattern / 64] |=
+          uint64_t(1) << (removal.pattern % 64);
+      on_pattern_restored(removal.index, removal.pattern);
+      restored(removal.index, removal.pattern);
+    }
+  }
+
+  /**
+   * Return true if there is a contradiction in the wave (all patterns
+   * removed from a cell).
+   */
+  bool is_impossible() const noexcept { return nb_impossible_cells > 0; }
+
+  /**
+   * Return the number of 64-bit words of the bitset of a cell.
+   */
+  unsigned get_nb_words() const noexcept { return nb_words; }
+
   /**
    * Return the index of the cell with lowest entropy different of 0.
    * If there is a contradiction in the wave, return -2.
    * If every cell is decided, return -1.
+   * A noise smaller than the smallest p * log(p) is added to the entropy of
+   * every cell, so ties are broken randomly.
    */
-  int get_min_entropy(std::minstd_rand &gen) const noexcept;
+  int get_min_entropy(std::minstd_rand &gen) noexcept;
 
 };
 
@@ -1,13 +1,37 @@
 #ifndef FAST_WFC_WFC_HPP_
 #define FAST_WFC_WFC_HPP_
 
+#include <chrono>
+#include <functional>
+#include <memory>
 #include <optional>
 #include <random>
+#include <utility>
 
 #include "utils/array2D.hpp"
+#include "model.hpp"
 #include "propagator.hpp"
 #include "wave.hpp"
 
+/**
+ * Options changing the way the generic WFC algorithm is run.
+ */
+struct WFCOptions {
+  // The way the cell with lowest entropy is found at every observation.
+  MinEntropySearch min_entropy_search = MinEntropySearch::indexed_heap;
+
+  // The order in which the propagator stores its compatibility counts.
+  CompatibleLayout compatible_layout = CompatibleLayout::direction_major;
+
+  // The algorithm used to propagate the removal of patterns.
+  PropagationEngine propagation_engine = PropagationEngine::automatic;
+
+  // The maximal number of decisions undone during a run after a
+  // contradiction. If it is 0, a contradiction makes the run fail, and the
+  // removals are not recorded.
+  unsigned max_backtracks = 0;
+};
+
 /**
  * Class containing the generic WFC algorithm.
  */
@@ -19,9 +43,9 @@ private:
   std::minstd_rand gen;
 
   /**
-   * The distribution of the patterns as given in input.
+   * The model, shared with the other WFC instances solving the same problem.
    */
-  const std::vector<double> patterns_frequencies;
+  std::shared_ptr<const Model> model;
 
   /**
    * The wave, indicating which patterns can be put in which cell.
@@ -39,26 +63,113 @@ private:
   Propagator propagator;
 
   /**
-   * Transform the wave to a valid output (a 2d array of patterns that aren't in
-   * contradiction). This function should be used only when all cell of the wave
-   * are defined.
+   * A pattern chosen for a cell by observe.
+   */
+  struct Decision {
+    std::size_t journal_size; // The size of the wave journal before it.
+    unsigned cell;
+    unsigned pattern;
+  };
+
+  /**
+   * The decisions that can still be undone, in order.
+   */
+  std::vector<Decision> decisions;
+
+  /**
+   * The maximal number of decisions that can be undone, and the number of
+   * decisions undone so far.
+   */
+  const unsigned max_backtracks;
+  unsigned nb_backtracks;
+
+  /**
+   * The observations and contradictions, if FAST_WFC_ENABLE_STATS is defined.
    */
-  Array2D<unsigned> wave_to_output() const noexcept;
+  WFCStats stats;
+
+  /**
+   * Undo the last decision and every removal that followed it, and remove the
+   * chosen pattern from its cell. Return false if there is no decision left to
+   * undo or if the backtrack budget is exhausted.
+   */
+  bool backtrack() noexcept;
+
+  /**
+   * Run the algorithm until it finishes or is_cancelled returns true, which
+   * is checked regularly. Return a result if it succeeded.
+   */
+  std::optional<Array2D<unsigned>>
+  run(const std::function<bool()> &is_cancelled) noexcept;
 
 public:
   /**
    * Basic constructor initializing the algorithm.
    */
   WFC(bool periodic_output, int seed, std::vector<double> patterns_frequencies,
-      Propagator::PropagatorState propagator, unsigned wave_height,
-      unsigned wave_width)
+      const Propagator::PropagatorState &propagator, unsigned wave_height,
+      unsigned wave_width, const WFCOptions &options = {})
     noexcept;
 
+  /**
+   * Constructor initializing the algorithm with a model, which can be shared
+   * with other instances. Only the state of the run is allocated.
+   */
+  WFC(bool periodic_output, int seed, std::shared_ptr<const Model> model,
+      unsigned wave_height, unsigned wave_width,
+      const WFCOptions &options = {}) noexcept;
+
+  /**
+   * The state of the algorithm at some point, used to start several runs from
+   * the same constraints.
+   */
+  struct Snapshot {
+    Wave wave;
+    Propagator propagator;
+    std::vector<Decision> decisions;
+    unsigned nb_backtracks;
+  };
+
+  /**
+   * Return the current state of the algorithm.
+   */
+  Snapshot snapshot() const noexcept {
+    return {wave, propagator, decisions, nb_backtracks};
+  }
+
+  /**
+   * Go back to a state returned by snapshot on this object (or on a copy of
+   * it), and reseed the random number generator.
+   * Nothing is propagated again, the state is only copied.
+   */
+  void restore(const Snapshot &snapshot, int seed) noexcept;
+
+  /**
+   * Return a copy of the algorithm in its current state, with the random
+   * number generator reseeded.
+   */
+  WFC clone(int seed) const noexcept {
+    WFC copy(*this);
+    copy.gen.seed(seed);
+    return copy;
+  }
+
   /**
    * Run the algorithm, and return a result if it succeeded.
    */
   std::optional<Array2D<unsigned>> run() noexcept;
 
+  /**
+   * Run the algorithm from the current state with every seed of seeds, on
+   * n_threads threads (0 meaning as many threads as the hardware supports).
+   * Return the first seed of the list that succeeded, with its result.
+   * The seeds are started in order, and an attempt is cancelled as soon as a
+   * seed before it succeeded, so the result only depends on seeds.
+   * The state of this object is not changed.
+   */
+  std::optional<std::pair<int, Array2D<unsigned>>>
+  run_parallel(unsigned n_threads, const std::vector<int> &seeds) const;
+
   /**
    * Return value of observe.
    */
@@ -74,9 +185,54 @@ public:
   ObserveStatus observe() noexcept;
 
   /**
-   * Propagate the information of the wave.
+   * Run the algorithm from where it stopped, propagating at most max_removals
+   * elements (see Propagator::propagate). A propagation is paused when the
+   * budget is exhausted, and resumed by the next call. Return success or
+   * failure if the algorithm has finished, and to_continue otherwise.
+   */
+  ObserveStatus step(std::size_t max_removals) noexcept;
+
+  /**
+   * Run the algorithm from where it stopped for about budget, and return as
+   * step. The clock is checked every few thousand removals, so the budget can
+   * be exceeded by the time of that many removals.
    */
-  void propagate() noexcept { propagator.propagate(wave); }
+  ObserveStatus run_for(std::chrono::nanoseconds budget) noexcept;
+
+  /**
+   * Return the output (a 2d array of patterns that aren't in contradiction),
+   * without any copy. The wave keeps the pattern of every decided cell, so this
+   * is free. This function should be used only when all cell of the wave are
+   * defined, for instance after step returned success.
+   */
+  const Array2D<unsigned> &get_output() const noexcept {
+    return wave.get_decided_patterns();
+  }
+
+  /**
+   * Return a copy of the output. See get_output.
+   */
+  Array2D<unsigned> wave_to_output() const noexcept { return get_output(); }
+
+  /**
+   * Return the statistics of the algorithm since its construction, including
+   * the ones of the wave and of the propagator. They are all 0 unless the
+   * library is built with FAST_WFC_ENABLE_STATS.
+   */
+  WFCStats get_stats() const noexcept {
+    WFCStats result = stats;
+    result += wave.get_stats();
+    result += propagator.get_stats();
+    return result;
+  }
+
+  /**
+   * Propagate the information of the wave. Return false if it led to a
+   * contradiction, in which case run fails at once.
+   */
+  bool propagate() noexcept {
+    return propagator.propagate(wave) != PropagationStatus::contradiction;
+  }
 
   /**
    * Remove pattern from cell (i,j).
@@ -87,6 +243,17 @@ public:
       propagator.add_to_propagator(i, j, pattern);
     }
   }
+
+  /**
+   * Remove every pattern but pattern from cell (i,j).
+   */
+  void set_pattern(unsigned i, unsigned j, unsigned pattern) noexcept {
+    for (unsigned p = 0; p < nb_patterns; p++) {
+      if (p != pattern) {
+        remove_wave_pattern(i, j, p);
+      }
+    }
+  }
 };
 
 #endif // FAST_WFC_WFC_HPP_
@@ -0,0 +1,124 @@
+#include "block_wfc.hpp"
+#include "utils/parallel.hpp"
+#include "utils/seed.hpp"
+
+#include <algorithm>
+#include <atomic>
+#include <cstdint>
+#include <limits>
+
+BlockWFC::BlockWFC(std::shared_ptr<const Model> model, unsigned height,
+                   unsigned width, const BlockWFCOptions &options,
+                   int seed) noexcept
+    : model(std::move(model)), options(options), seed(seed),
+      output(height, width), is_decided(height * width, 0),
+      is_fixed(height * width, 0) {
+  // The overlaps of two blocks of the same phase should not meet.
+  this->options.block_size = std::max(1u, options.block_size);
+  this->options.overlap =
+      std::min(options.overlap, (this->options.block_size - 1) / 2);
+}
+
+int BlockWFC::get_block_seed(unsigned block_y, unsigned block_x,
+                             unsigned attempt) const noexcept {
+  return get_region_seed(seed, block_y, block_x, attempt);
+}
+
+bool BlockWFC::solve_block(unsigned block_y, unsigned block_x) noexcept {
+  // The region solved: the block and the overlap, inside the output.
+  const unsigned size = options.block_size;
+  const unsigned overlap = options.overlap;
+  const unsigned output_height = static_cast<unsigned>(output.height);
+  const unsigned output_width = static_cast<unsigned>(output.width);
+  unsigned y0 = block_y * size;
+  unsigned x0 = block_x * size;
+  unsigned y1 = std::min(y0 + size + overlap, output_height);
+  unsigned x1 = std::min(x0 + size + overlap, output_width);
+  y0 = y0 >= overlap ? y0 - overlap : 0;
+  x0 = x0 >= overlap ? x0 - overlap : 0;
+
+  // The wave contains the region and a ring of one cell around it.
+  const unsigned height = y1 - y0 + 2;
+  const unsigned width = x1 - x0 + 2;
+  WFC wfc(false, seed, model, height, width, options.wfc_options);
+  const WFC::Snapshot initial_state = wfc.snapshot();
+
+  for (unsigned attempt = 0; attempt < options.nb_attempts; attempt++) {
+    wfc.restore(initial_state, get_block_seed(block_y, block_x, attempt));
+
+    for (unsigned i = 0; i < height; i++) {
+      for (unsigned j = 0; j < width; j++) {
+        // The cells of the ring outside the output are left free.
+        int y = static_cast<int>(y0 + i) - 1;
+        int x = static_cast<int>(x0 + j) - 1;
+        if (y < 0 || x < 0 || y >= static_cast<int>(output_height) ||
+            x >= static_cast<int>(output_width)) {
+          continue;
+        }
+
+        // The decided cells of the ring and the fixed cells are kept, the
+        // other cells are solved.
+        unsigned cell = y * output.width + x;
+        bool is_ring = i == 0 || j == 0 || i == height - 1 || j == width - 1;
+        if (is_fixed[cell] || (is_ring && is_decided[cell])) {
+          wfc.set_pattern(i, j, output.data[cell]);
+        } else if (!is_ring) {
+          for (unsigned pattern : banned_patterns) {
+            wfc.remove_wave_pattern(i, j, pattern);
+          }
+        }
+      }
+    }
+    // The constraints do not depend on the seed, so if they are
+    // contradictory, no attempt can succeed.
+    if (!wfc.propagate()) {
+      return false;
+    }
+
+    if (wfc.step(std::numeric_limits<std::size_t>::max()) != WFC::success) {
+      continue;
+    }
+    const Array2D<unsigned> &result = wfc.get_output();
+
+    for (unsigned y = y0; y < y1; y++) {
+      for (unsigned x = x0; x < x1; x++) {
+        unsigned cell = y * output.width + x;
+        if (!is_fixed[cell]) {
+          output.data[cell] = result.get(y - y0 + 1, x - x0 + 1);
+          is_decided[cell] = 1;
+        }
+      }
+    }
+    return true;
+  }
+  return false;
+}
+
+std::optional<Array2D<unsigned>> BlockWFC::run() noexcept {
+  const unsigned size = options.block_size;
+  const unsigned nb_blocks_y = (output.height + size - 1) / size;
+  const unsigned nb_blocks_x = (output.width + size - 1) / size;
+
+  // The parities of the coordinates of the blocks of every phase. The blocks
+  // of the last phase are surrounded by solved blocks.
+  const unsigned phases[4][2] = {{0, 0}, {0, 1}, {1, 0}, {1, 1}};
+  for (const auto &phase : phases) {
+    std::vector<std::pair<unsigned, unsigned>> blocks;
+    for (unsigned block_y = phase[0]; block_y < nb_blocks_y; block_y += 2) {
+      for (unsigned block_x = phase[1]; block_x < nb_blocks_x; block_x += 2) {
+        blocks.emplace_back(block_y, block_x);
+      }
+    }
+
+    std::atomic<bool> failed(false);
+    parallel_for(options.nb_threads, blocks.size(), [&](std::size_t i) {
+      if (!failed.load() && !solve_block(blocks[i].first, blocks[i].second)) {
+        failed.store(true);
+      }
+    });
+    if (failed.load()) {
+      return std::nullopt;
+    }
+  }
+  return output;
+}
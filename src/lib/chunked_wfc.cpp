@@ -0,0 +1,87 @@
+#include "chunked_wfc.hpp"
+#include "utils/seed.hpp"
+
+#include <cstdint>
+#include <limits>
+
+ChunkedWFC::ChunkedWFC(std::shared_ptr<const Model> model,
+                       const ChunkedWFCOptions &options, int seed) noexcept
+    : options(options), seed(seed),
+      wfc(false, seed, std::move(model), options.chunk_height + 2,
+          options.chunk_width + 2, options.wfc_options),
+      initial_state(wfc.snapshot()) {}
+
+const ChunkedWFC::Borders *ChunkedWFC::get_borders(int chunk_y,
+                                                   int chunk_x) const noexcept {
+  auto it = borders.find({chunk_y, chunk_x});
+  return it == borders.end() ? nullptr : &it->second;
+}
+
+int ChunkedWFC::get_chunk_seed(int chunk_y, int chunk_x,
+                               unsigned attempt) const noexcept {
+  return get_region_seed(seed, static_cast<uint32_t>(chunk_y),
+                         static_cast<uint32_t>(chunk_x), attempt);
+}
+
+std::optional<Array2D<unsigned>> ChunkedWFC::generate(int chunk_y,
+                                                      int chunk_x) noexcept {
+  const unsigned height = options.chunk_height;
+  const unsigned width = options.chunk_width;
+  const Borders *north = get_borders(chunk_y - 1, chunk_x);
+  const Borders *south = get_borders(chunk_y + 1, chunk_x);
+  const Borders *west = get_borders(chunk_y, chunk_x - 1);
+  const Borders *east = get_borders(chunk_y, chunk_x + 1);
+
+  for (unsigned attempt = 0; attempt < options.nb_attempts; attempt++) {
+    wfc.restore(initial_state, get_chunk_seed(chunk_y, chunk_x, attempt));
+
+    // The borders of the neighbors are placed in the margin, and the margin
+    // cells without a generated neighbor are left free.
+    for (unsigned j = 0; j < width; j++) {
+      if (north) {
+        wfc.set_pattern(0, j + 1, north->bottom[j]);
+      }
+      if (south) {
+        wfc.set_pattern(height + 1, j + 1, south->top[j]);
+      }
+    }
+    for (unsigned i = 0; i < height; i++) {
+      if (west) {
+        wfc.set_pattern(i + 1, 0, west->right[i]);
+      }
+      if (east) {
+        wfc.set_pattern(i + 1, width + 1, east->left[i]);
+      }
+    }
+    // The constraints do not depend on the seed, so if they are
+    // contradictory, no attempt can succeed.
+    if (!wfc.propagate()) {
+      return std::nullopt;
+    }
+
+    if (wfc.step(std::numeric_limits<std::size_t>::max()) != WFC::success) {
+      continue;
+    }
+    const Array2D<unsigned> &result = wfc.get_output();
+
+    // The chunk is the wave without its margin.
+    Array2D<unsigned> chunk(height, width);
+    for (unsigned i = 0; i < height; i++) {
+      for (unsigned j = 0; j < width; j++) {
+        chunk.get(i, j) = result.get(i + 1, j + 1);
+      }
+    }
+
+    Borders &chunk_borders = borders[{chunk_y, chunk_x}];
+    chunk_borders.top.assign(chunk.data.begin(), chunk.data.begin() + width);
+    chunk_borders.bottom.assign(chunk.data.end() - width, chunk.data.end());
+    chunk_borders.left.resize(height);
+    chunk_borders.right.resize(height);
+    for (unsigned i = 0; i < height; i++) {
+      chunk_borders.left[i] = chunk.get(i, 0);
+      chunk_borders.right[i] = chunk.get(i, width - 1);
+    }
+    return chunk;
+  }
+  return std::nullopt;
+}
@@ -0,0 +1,179 @@
+#include "model.hpp"
+
+#include <algorithm>
+#include <cmath>
+#include <functional>
+#include <limits>
+
+namespace {
+
+/**
+ * Normalize a vector so the sum of its elements is equal to 1.0f
+ */
+std::vector<double> normalize(std::vector<double> v) noexcept {
+  double sum_weights = 0.0;
+  for (double weight : v) {
+    sum_weights += weight;
+  }
+
+  double inv_sum_weights = 1.0 / sum_weights;
+  for (double &weight : v) {
+    weight *= inv_sum_weights;
+  }
+
+  return v;
+}
+
+/**
+ * Return distribution * log(distribution).
+ */
+std::vector<double>
+get_plogp(const std::vector<double> &distribution) noexcept {
+  std::vector<double> plogp;
+  for (unsigned i = 0; i < distribution.size(); i++) {
+    plogp.push_back(distribution[i] * log(distribution[i]));
+  }
+  return plogp;
+}
+
+/**
+ * Return min(v) / 2.
+ */
+double get_min_abs_half(const std::vector<double> &v) noexcept {
+  double min_abs_half = std::numeric_limits<double>::infinity();
+  for (unsigned i = 0; i < v.size(); i++) {
+    min_abs_half = std::min(min_abs_half, std::abs(v[i] / 2.0));
+  }
+  return min_abs_half;
+}
+
+/**
+ * Return true if all the elements of v are equal.
+ */
+bool are_all_equal(const std::vector<double> &v) noexcept {
+  return std::adjacent_find(v.begin(), v.end(), std::not_equal_to<double>()) ==
+         v.end();
+}
+
+/**
+ * Return log(n) for n in [1, nb_patterns], after a 0 for n = 0 which is never
+ * used, or an empty vector if uniform_frequencies is false.
+ */
+std::vector<double> get_log_counts(std::size_t nb_patterns,
+                                   bool uniform_frequencies) noexcept {
+  if (!uniform_frequencies) {
+    return {};
+  }
+  std::vector<double> log_counts(nb_patterns + 1, 0);
+  for (std::size_t n = 1; n <= nb_patterns; n++) {
+    log_counts[n] = log(static_cast<double>(n));
+  }
+  return log_counts;
+}
+
+/**
+ * Copy the lists of propagator_state in a single table indexed with Index.
+ */
+template <typename Index>
+AdjacencyTable<Index>
+compile_adjacency(const Model::PropagatorState &propagator_state) noexcept {
+  AdjacencyTable<Index> table;
+  std::size_t nb_indices = 0;
+  for (const auto &patterns : propagator_state) {
+    for (const std::vector<unsigned> &support : patterns) {
+      nb_indices += support.size();
+    }
+  }
+
+  table.offsets.reserve(propagator_state.size() * 4 + 1);
+  table.indices.reserve(nb_indices);
+  table.offsets.push_back(0);
+  for (const auto &patterns : propagator_state) {
+    for (const std::vector<unsigned> &support : patterns) {
+      for (unsigned pattern : support) {
+        table.indices.push_back(static_cast<Index>(pattern));
+      }
+      table.offsets.push_back(table.indices.size());
+    }
+  }
+  return table;
+}
+
+/**
+ * Compile the propagator state in a table with the smallest index type.
+ */
+decltype(Model::adjacency)
+make_adjacency(const Model::PropagatorState &propagator_state) noexcept {
+  std::size_t nb_patterns = propagator_state.size();
+  if (nb_patterns <= std::size_t(std::numeric_limits<uint8_t>::max()) + 1) {
+    return compile_adjacency<uint8_t>(propagator_state);
+  }
+  if (nb_patterns <= std::size_t(std::numeric_limits<uint16_t>::max()) + 1) {
+    return compile_adjacency<uint16_t>(propagator_state);
+  }
+  return compile_adjacency<uint32_t>(propagator_state);
+}
+
+/**
+ * Return the size of the biggest list of the propagator state.
+ */
+std::size_t
+get_max_support(const Model::PropagatorState &propagator_state) noexcept {
+  std::size_t max_support = 0;
+  for (const auto &patterns : propagator_state) {
+    for (const std::vector<unsigned> &support : patterns) {
+      max_support = std::max(max_support, support.size());
+    }
+  }
+  return max_support;
+}
+
+/**
+ * Return the proportion of (pattern1, direction, pattern2) that are
+ * compatible.
+ */
+double get_density(const Model::PropagatorState &propagator_state) noexcept {
+  std::size_t nb_compatible = 0;
+  for (const auto &patterns : propagator_state) {
+    for (const std::vector<unsigned> &support : patterns) {
+      nb_compatible += support.size();
+    }
+  }
+  double nb_patterns = static_cast<double>(propagator_state.size());
+  return nb_compatible / (4 * nb_patterns * nb_patterns);
+}
+
+} // namespace
+
+Model::Model(std::vector<double> patterns_frequencies,
+             const PropagatorState &propagator_state) noexcept
+    : nb_patterns(propagator_state.size()),
+      patterns_frequencies(normalize(std::move(patterns_frequencies))),
+      plogp_patterns_frequencies(get_plogp(this->patterns_frequencies)),
+      min_abs_half_plogp(get_min_abs_half(plogp_patterns_frequencies)),
+      uniform_frequencies(are_all_equal(this->patterns_frequencies)),
+      log_counts(get_log_counts(nb_patterns, uniform_frequencies)),
+      adjacency(make_adjacency(propagator_state)),
+      max_support(get_max_support(propagator_state)),
+      density(get_density(propagator_state)),
+      nb_words(static_cast<unsigned>((nb_patterns + 63) / 64)) {}
+
+const uint64_t *Model::get_masks() const noexcept {
+  std::call_once(masks_flag, [&]() {
+    masks = decltype(masks)(nb_patterns * 4 * nb_words, 0);
+    std::visit(
+        [&](const auto &adjacency) {
+          for (unsigned pattern = 0; pattern < nb_patterns; pattern++) {
+            for (unsigned direction = 0; direction < 4; direction++) {
+              uint64_t *mask = &masks[(pattern * 4 + direction) * nb_words];
+              for (auto it = adjacency.begin(pattern, direction);
+                   it < adjacency.end(pattern, direction); ++it) {
+                mask[*it / 64] |= uint64_t(1) << (*it % 64);
+              }
+            }
+          }
+        },
+        adjacency);
+  });
+  return masks.data();
+}
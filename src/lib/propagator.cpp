@@ -1,27 +1,144 @@
 #include "propagator.hpp"
 #include "wave.hpp"
 
+#include <algorithm>
+#include <limits>
+
+namespace {
+
+/**
+ * The minimal density of the rules (the proportion of (pattern1, direction,
+ * pattern2) that are compatible) for which the bitsets engine is chosen
+ * automatically.
+ */
+constexpr double bitsets_min_density = 0.2;
+
+} // namespace
+
+Propagator::Propagator(unsigned wave_height, unsigned wave_width,
+                       bool periodic_output, std::shared_ptr<const Model> model,
+                       CompatibleLayout layout,
+                       PropagationEngine engine) noexcept
+    : model(std::move(model)), patterns_size(this->model->nb_patterns),
+      wave_width(wave_width), wave_height(wave_height),
+      periodic_output(periodic_output),
+      engine(choose_engine(engine, *this->model)),
+      compatible(make_compatible(wave_height, wave_width, *this->model,
+                                 this->engine)),
+      layout(layout), nb_words(this->model->nb_words), masks(nullptr) {
+  if (this->engine == PropagationEngine::counters) {
+    init_compatible();
+  } else {
+    masks = this->model->get_masks();
+    is_propagating = std::vector<uint8_t>(wave_height * wave_width, 0);
+  }
+}
+
+PropagationEngine Propagator::choose_engine(PropagationEngine engine,
+                                            const Model &model) noexcept {
+  if (engine != PropagationEngine::automatic) {
+    return engine;
+  }
+
+  // The counters engine does work proportional to the number of compatible
+  // patterns, while the bitsets engine does work proportional to the number
+  // of patterns. The bitsets are then better when the rules are dense.
+  return model.density >= bitsets_min_density ? PropagationEngine::bitsets
+                                              : PropagationEngine::counters;
+}
+
+decltype(Propagator::compatible) Propagator::make_compatible(
+    unsigned wave_height, unsigned wave_width, const Model &model,
+    PropagationEngine engine) noexcept {
+  // The size of the biggest list bounds every count.
+  std::size_t max_support = model.max_support;
+  std::size_t size =
+      std::size_t(wave_height) * wave_width * model.nb_patterns * 4;
+  if (engine == PropagationEngine::bitsets) {
+    size = 0;
+  }
+  if (max_support <= std::numeric_limits<uint8_t>::max()) {
+    return CompatibleArray<uint8_t>(size);
+  }
+  if (max_support <= std::numeric_limits<uint16_t>::max()) {
+    return CompatibleArray<uint16_t>(size);
+  }
+  return CompatibleArray<uint32_t>(size);
+}
+
 void Propagator::init_compatible() noexcept {
-  std::array<int, 4> value;
+  std::visit(
+      [&](auto &compatible, const auto &adjacency) {
+        if (layout == CompatibleLayout::pattern_major) {
+          init_compatible<CompatibleLayout::pattern_major>(compatible,
+                                                           adjacency);
+        } else {
+          init_compatible<CompatibleLayout::direction_major>(compatible,
+                                                             adjacency);
+        }
+      },
+      compatible, model->adjacency);
+}
+
+template <CompatibleLayout Layout, typename Counter, typename Index>
+void Propagator::init_compatible(
+    CompatibleArray<Counter> &compatible,
+    const AdjacencyTable<Index> &adjacency) noexcept {
   // We compute the number of pattern compatible in all directions.
-  for (unsigned y = 0; y < wave_height; y++) {
-    for (unsigned x = 0; x < wave_width; x++) {
+  for (unsigned cell = 0; cell < wave_height * wave_width; cell++) {
+    for (unsigned direction = 0; direction < 4; direction++) {
       for (unsigned pattern = 0; pattern < patterns_size; pattern++) {
-        for (int direction = 0; direction < 4; direction++) {
-          value[direction] =
-            static_cast<unsigned>(propagator_state[pattern][get_opposite_direction(direction)]
-                                  .size());
-        }
-        compatible.get(y, x, pattern) = value;
+        compatible[get_compatible_index<Layout>(cell, pattern, direction)] =
+            static_cast<Counter>(
+                adjacency.size(pattern, get_opposite_direction(direction)));
       }
     }
   }
 }
 
-void Propagator::propagate(Wave &wave) noexcept {
+PropagationStatus Propagator::propagate(Wave &wave,
+                                        std::size_t &max_elements) noexcept {
+  FAST_WFC_STATS(ScopedTimer timer(stats.propagation_time);)
+  if (engine == PropagationEngine::bitsets) {
+    max_elements -= propagate_bitsets(wave, max_elements);
+  } else {
+    max_elements -= std::visit(
+        [&](auto &compatible, const auto &adjacency) {
+          if (layout == CompatibleLayout::pattern_major) {
+            return propagate<CompatibleLayout::pattern_major>(
+                wave, compatible, adjacency, max_elements);
+          } else {
+            return propagate<CompatibleLayout::direction_major>(
+                wave, compatible, adjacency, max_elements);
+          }
+        },
+        compatible, model->adjacency);
+  }
+
+  if (wave.is_impossible()) {
+    return PropagationStatus::contradiction;
+  }
+  return is_empty() ? PropagationStatus::done : PropagationStatus::paused;
+}
+
+template <CompatibleLayout Layout, typename Counter, typename Index>
+std::size_t Propagator::propagate(Wave &wave,
+                                  CompatibleArray<Counter> &compatible,
+                                  const AdjacencyTable<Index> &adjacency,
+                                  std::size_t max_elements) noexcept {
+  // The distance between the counts of two consecutive patterns of a (cell,
+  // direction).
+  constexpr std::size_t stride =
+      Layout == CompatibleLayout::pattern_major ? 4 : 1;
 
-  // We propagate every element while there is element to propagate.
-  while (propagating.size() != 0) {
+  // We propagate every element while there is element to propagate, the
+  // budget is not exhausted and there is no contradiction. An element is
+  // always propagated entirely, so the propagation can be resumed later, and
+  // the counts stay exact.
+  std::size_t nb_propagated = 0;
+  while (propagating.size() != 0 && nb_propagated < max_elements &&
+         !wave.is_impossible()) {
+    nb_propagated++;
 
     // The cell and pattern that has been set to false.
     unsigned y1, x1, pattern;
@@ -49,29 +166,165 @@ void Propagator::propagate(Wave &wave) noexcept {
         }
       }
 
-      // The index of the second cell, and the patterns compatible
+      // The index of the second cell, and the counts of its patterns in the
+      // direction direction.
       unsigned i2 = x2 + y2 * wave.width;
-      const std::vector<unsigned> &patterns =
-        propagator_state[pattern][direction];
+      Counter *counts =
+          &compatible[get_compatible_index<Layout>(i2, 0, direction)];
 
       // For every pattern that could be placed in that cell without being in
       // contradiction with pattern1
-      for (auto it = patterns.begin(), it_end = patterns.end(); it < it_end;
-           ++it) {
+      for (const Index *it = adjacency.begin(pattern, direction),
+                       *it_end = adjacency.end(pattern, direction);
+           it < it_end; ++it) {
 
         // We decrease the number of compatible patterns in the opposite
-        // direction If the pattern was discarded from the wave, the element
-        // is still negative, which is not a problem
-        std::array<int, 4> &value = compatible.get(y2, x2, *it);
-        value[direction]--;
+        // direction. Since the counts are exact, they never go below 0.
+        Counter &value = counts[*it * stride];
+        value--;
 
         // If the element was set to 0 with this operation, we need to remove
-        // the pattern from the wave, and propagate the information
-        if (value[direction] == 0) {
+        // the pattern from the wave (if it wasn't already removed), and
+        // propagate the information
+        if (value == 0 && wave.get(i2, *it)) {
           add_to_propagator(y2, x2, *it);
           wave.set(i2, *it, false);
         }
       }
     }
   }
+  return nb_propagated;
+}
+
+std::size_t Propagator::propagate_bitsets(Wave &wave,
+                                         std::size_t max_elements) noexcept {
+  // The union of the masks of the patterns of a cell.
+  std::vector<uint64_t, AlignedAllocator<uint64_t, 64>> allowed(nb_words);
+
+  // We propagate every cell while there is cell to propagate, the budget is
+  // not exhausted and there is no contradiction.
+  std::size_t nb_propagated = 0;
+  while (propagating_cells.size() != 0 && nb_propagated < max_elements &&
+         !wave.is_impossible()) {
+    nb_propagated++;
+
+    // The cell where patterns have been set to false.
+    unsigned i1 = propagating_cells.back();
+    propagating_cells.pop_back();
+    is_propagating[i1] = 0;
+    unsigned y1 = i1 / wave.width;
+    unsigned x1 = i1 % wave.width;
+
+    // We propagate the information in all 4 directions.
+    for (unsigned direction = 0; direction < 4; direction++) {
+
+      // We get the next cell in the direction direction.
+      int dx = directions_x[direction];
+      int dy = directions_y[direction];
+      int x2, y2;
+      if (periodic_output) {
+        x2 = ((int)x1 + dx + (int)wave.width) % wave.width;
+        y2 = ((int)y1 + dy + (int)wave.height) % wave.height;
+      } else {
+        x2 = x1 + dx;
+        y2 = y1 + dy;
+        if (x2 < 0 || x2 >= (int)wave.width) {
+          continue;
+        }
+        if (y2 < 0 || y2 >= (int)wave.height) {
+          continue;
+        }
+      }
+
+      // The patterns allowed in the second cell are the ones compatible with
+      // at least one pattern of the first cell.
+      std::fill(allowed.begin(), allowed.end(), 0);
+      wave.for_each(i1, [&](unsigned pattern) {
+        const uint64_t *mask = &masks[(pattern * 4 + direction) * nb_words];
+        for (unsigned w = 0; w < nb_words; w++) {
+          allowed[w] |= mask[w];
+        }
+      });
+
+      // We remove the other patterns from the second cell, and propagate the
+      // information if the cell has changed.
+      unsigned i2 = x2 + y2 * wave.width;
+      bool changed = false;
+      wave.intersect(i2, allowed.data(), [&](unsigned) { changed = true; });
+      if (changed) {
+        add_cell_to_propagator(i2);
+      }
+    }
+  }
+  return nb_propagated;
+}
+
+void Propagator::clear() noexcept {
+  for (auto [y, x, pattern] : propagating) {
+    update_counts(y, x, pattern, false);
+  }
+  propagating.clear();
+  for (unsigned cell : propagating_cells) {
+    is_propagating[cell] = 0;
+  }
+  propagating_cells.clear();
+}
+
+void Propagator::update_counts(unsigned y, unsigned x, unsigned pattern,
+                               bool increment) noexcept {
+  std::visit(
+      [&](auto &compatible, const auto &adjacency) {
+        if (layout == CompatibleLayout::pattern_major) {
+          update_counts<CompatibleLayout::pattern_major>(
+              compatible, adjacency, y, x, pattern, increment);
+        } else {
+          update_counts<CompatibleLayout::direction_major>(
+              compatible, adjacency, y, x, pattern, increment);
+        }
+      },
+      compatible, model->adjacency);
+}
+
+template <CompatibleLayout Layout, typename Counter, typename Index>
+void Propagator::update_counts(CompatibleArray<Counter> &compatible,
+                               const AdjacencyTable<Index> &adjacency,
+                               unsigned y1, unsigned x1, unsigned pattern,
+                               bool increment) noexcept {
+  constexpr std::size_t stride =
+      Layout == CompatibleLayout::pattern_major ? 4 : 1;
+
+  for (unsigned direction = 0; direction < 4; direction++) {
+
+    // We get the next cell in the direction direction.
+    int dx = directions_x[direction];
+    int dy = directions_y[direction];
+    int x2, y2;
+    if (periodic_output) {
+      x2 = ((int)x1 + dx + (int)wave_width) % wave_width;
+      y2 = ((int)y1 + dy + (int)wave_height) % wave_height;
+    } else {
+      x2 = x1 + dx;
+      y2 = y1 + dy;
+      if (x2 < 0 || x2 >= (int)wave_width) {
+        continue;
+      }
+      if (y2 < 0 || y2 >= (int)wave_height) {
+        continue;
+      }
+    }
+
+    // The same counts as the ones decreased by propagate.
+    unsigned i2 = x2 + y2 * wave_width;
+    Counter *counts =
+        &compatible[get_compatible_index<Layout>(i2, 0, direction)];
+    for (const Index *it = adjacency.begin(pattern, direction),
+                     *it_end = adjacency.end(pattern, direction);
+         it < it_end; ++it) {
+      if (increment) {
+        counts[*it * stride]++;
+      } else {
+        counts[*it * stride]--;
+      }
+    }
+  }
 }
@@ -1,105 +1,192 @@
 #include "wave.hpp"
 
+#include <algorithm>
 #include <limits>
 
-namespace {
-
-/**
- * Return distribution * log(distribution).
- */
-std::vector<double>
-get_plogp(const std::vector<double> &distribution) noexcept {
-  std::vector<double> plogp;
-  for (unsigned i = 0; i < distribution.size(); i++) {
-    plogp.push_back(distribution[i] * log(distribution[i]));
-  }
-  return plogp;
-}
-
-/**
- * Return min(v) / 2.
- */
-double get_min_abs_half(const std::vector<double> &v) noexcept {
-  double min_abs_half = std::numeric_limits<double>::infinity();
-  for (unsigned i = 0; i < v.size(); i++) {
-    min_abs_half = std::min(min_abs_half, std::abs(v[i] / 2.0));
-  }
-  return min_abs_half;
-}
-
-} // namespace
-
-Wave::Wave(unsigned height, unsigned width,
-     const std::vector<double> &patterns_frequencies) noexcept
-  : patterns_frequencies(patterns_frequencies),
-    plogp_patterns_frequencies(get_plogp(patterns_frequencies)),
-    min_abs_half_plogp(get_min_abs_half(plogp_patterns_frequencies)),
-    is_impossible(false), nb_patterns(patterns_frequencies.size()),
-    data(width * height, nb_patterns, 1), width(width), height(height),
-    size(height * width) {
+Wave::Wave(unsigned height, unsigned width, std::shared_ptr<const Model> model,
+     MinEntropySearch min_entropy_search) noexcept
+  : model(std::move(model)), nb_impossible_cells(0),
+    nb_patterns(this->model->nb_patterns),
+    nb_words(static_cast<unsigned>((nb_patterns + 63) / 64)),
+    data(width * height * nb_words), patterns_xor(height, width, 0),
+    undecided_cells(width * height), journaling(false),
+    min_entropy_search(min_entropy_search), entropy_heap(width * height),
+    width(width), height(height), size(height * width) {
   // Initialize the memoisation of entropy.
   double base_entropy = 0;
   double base_s = 0;
   for (unsigned i = 0; i < nb_patterns; i++) {
-    base_entropy += plogp_patterns_frequencies[i];
-    base_s += patterns_frequencies[i];
+    base_entropy += this->model->plogp_patterns_frequencies[i];
+    base_s += this->model->patterns_frequencies[i];
   }
-  double log_base_s = log(base_s);
-  double entropy_base = log_base_s - base_entropy / base_s;
+  double entropy_base = log(base_s) - base_entropy / base_s;
   memoisation.plogp_sum = std::vector<double>(width * height, base_entropy);
   memoisation.sum = std::vector<double>(width * height, base_s);
-  memoisation.log_sum = std::vector<double>(width * height, log_base_s);
   memoisation.nb_patterns =
     std::vector<unsigned>(width * height, static_cast<unsigned>(nb_patterns));
   memoisation.entropy = std::vector<double>(width * height, entropy_base);
+  memoisation.is_outdated = std::vector<uint8_t>(width * height, 0);
+
+  // Every pattern is present in every cell.
+  unsigned all_patterns_xor = 0;
+  for (unsigned i = 0; i < nb_patterns; i++) {
+    all_patterns_xor ^= i;
+  }
+  std::fill(patterns_xor.data.begin(), patterns_xor.data.end(),
+            all_patterns_xor);
+  if (nb_patterns > 1) {
+    for (unsigned i = 0; i < width * height; i++) {
+      undecided_cells.insert(i);
+    }
+  }
+
+  // Initialize the wave with every pattern in every cell. The bits after the
+  // last pattern are left unset.
+  for (unsigned i = 0; i < width * height; i++) {
+    for (unsigned w = 0; w < nb_words; w++) {
+      unsigned nb_bits = std::min<unsigned>(64, nb_patterns - w * 64);
+      data[i * nb_words + w] =
+          nb_bits == 64 ? ~uint64_t(0) : (uint64_t(1) << nb_bits) - 1;
+    }
+  }
+
+  // Every cell has to be inserted in the heap on the first call to
+  // get_min_entropy.
+  if (min_entropy_search == MinEntropySearch::indexed_heap) {
+    changed_cells.resize(width * height);
+    for (unsigned i = 0; i < width * height; i++) {
+      changed_cells[i] = i;
+    }
+    is_changed = std::vector<uint8_t>(width * height, 1);
+  }
+}
+
+
+void Wave::copy_state(const Wave &other) noexcept {
+  memoisation.plogp_sum = other.memoisation.plogp_sum;
+  memoisation.sum = other.memoisation.sum;
+  memoisation.nb_patterns = other.memoisation.nb_patterns;
+  memoisation.entropy = other.memoisation.entropy;
+  memoisation.is_outdated = other.memoisation.is_outdated;
+  nb_impossible_cells = other.nb_impossible_cells;
+  data = other.data;
+  patterns_xor.data = other.patterns_xor.data;
+  undecided_cells = other.undecided_cells;
+  journaling = other.journaling;
+  journal = other.journal;
+  entropy_heap = other.entropy_heap;
+  changed_cells = other.changed_cells;
+  is_changed = other.is_changed;
 }
 
 
 void Wave::set(unsigned index, unsigned pattern, bool value) noexcept {
-  bool old_value = data.get(index, pattern);
+  bool old_value = get(index, pattern);
   // If the value isn't changed, nothing needs to be done.
   if (old_value == value) {
     return;
   }
   // Otherwise, the memoisation should be updated.
-  data.get(index, pattern) = value;
-  memoisation.plogp_sum[index] -= plogp_patterns_frequencies[pattern];
-  memoisation.sum[index] -= patterns_frequencies[pattern];
-  memoisation.log_sum[index] = log(memoisation.sum[index]);
+  data[index * nb_words + pattern / 64] ^= uint64_t(1) << (pattern % 64);
+  if (value) {
+    on_pattern_restored(index, pattern);
+  } else {
+    on_pattern_removed(index, pattern);
+  }
+}
+
+
+void Wave::on_pattern_removed(unsigned index, unsigned pattern) noexcept {
+  FAST_WFC_STATS(stats.nb_removals++;)
+  memoisation.plogp_sum[index] -= model->plogp_patterns_frequencies[pattern];
+  memoisation.sum[index] -= model->patterns_frequencies[pattern];
   memoisation.nb_patterns[index]--;
-  memoisation.entropy[index] =
-    memoisation.log_sum[index] -
-    memoisation.plogp_sum[index] / memoisation.sum[index];
+  memoisation.is_outdated[index] = 1;
+  patterns_xor.data[index] ^= pattern;
   // If there is no patterns possible in the cell, then there is a
-  // contradiction.
+  // contradiction. A cell with one pattern left is decided.
+  if (memoisation.nb_patterns[index] == 1) {
+    undecided_cells.remove(index);
+  } else if (memoisation.nb_patterns[index] == 0) {
+    nb_impossible_cells++;
+  }
+  if (journaling) {
+    journal.push_back({index, pattern});
+  }
+  // The key of the cell in the heap will be updated lazily.
+  if (min_entropy_search == MinEntropySearch::indexed_heap &&
+      !is_changed[index]) {
+    is_changed[index] = 1;
+    changed_cells.push_back(index);
+  }
+}
+
+
+void Wave::on_pattern_restored(unsigned index, unsigned pattern) noexcept {
   if (memoisation.nb_patterns[index] == 0) {
-    is_impossible = true;
+    nb_impossible_cells--;
+  }
+  memoisation.plogp_sum[index] += model->plogp_patterns_frequencies[pattern];
+  memoisation.sum[index] += model->patterns_frequencies[pattern];
+  memoisation.nb_patterns[index]++;
+  memoisation.is_outdated[index] = 1;
+  patterns_xor.data[index] ^= pattern;
+  if (memoisation.nb_patterns[index] == 2) {
+    undecided_cells.insert(index);
+  }
+  if (min_entropy_search == MinEntropySearch::indexed_heap &&
+      !is_changed[index]) {
+    is_changed[index] = 1;
+    changed_cells.push_back(index);
   }
 }
 
 
-int Wave::get_min_entropy(std::minstd_rand &gen) const noexcept {
-  if (is_impossible) {
+inline double Wave::get_entropy(unsigned index) noexcept {
+  if (model->uniform_frequencies) {
+    return model->log_counts[memoisation.nb_patterns[index]];
+  }
+  if (memoisation.is_outdated[index]) {
+    FAST_WFC_STATS(stats.nb_log_calls++;)
+    memoisation.is_outdated[index] = 0;
+    memoisation.entropy[index] =
+        log(memoisation.sum[index]) -
+        memoisation.plogp_sum[index] / memoisation.sum[index];
+  }
+  return memoisation.entropy[index];
+}
+
+
+int Wave::get_min_entropy(std::minstd_rand &gen) noexcept {
+  FAST_WFC_STATS(ScopedTimer timer(stats.min_entropy_time);)
+  if (is_impossible()) {
     return -2;
   }
 
-  std::uniform_real_distribution<> dis(0, min_abs_half_plogp);
+  // Every cell is decided, which is known without visiting them.
+  if (undecided_cells.empty()) {
+    return -1;
+  }
+
+  if (min_entropy_search == MinEntropySearch::indexed_heap) {
+    return get_min_entropy_indexed_heap(gen);
+  }
+  return get_min_entropy_linear_scan(gen);
+}
+
+
+int Wave::get_min_entropy_linear_scan(std::minstd_rand &gen) noexcept {
+  std::uniform_real_distribution<> dis(0, model->min_abs_half_plogp);
 
   // The minimum entropy (plus a small noise)
   double min = std::numeric_limits<double>::infinity();
   int argmin = -1;
 
-  for (unsigned i = 0; i < size; i++) {
+  // The decided cells, whose entropy is 0, are not in the set.
+  for (unsigned i : undecided_cells) {
 
-    // If the cell is decided, we do not compute the entropy (which is equal
-    // to 0).
-    double nb_patterns_local = memoisation.nb_patterns[i];
-    if (nb_patterns_local == 1) {
-      continue;
-    }
-
-    // Otherwise, we take the memoised entropy.
-    double entropy = memoisation.entropy[i];
+    // We take the memoised entropy.
+    double entropy = get_entropy(i);
 
     // We first check if the entropy is less than the minimum.
     // This is important to reduce noise computation (which is not
@@ -119,3 +206,30 @@ int Wave::get_min_entropy(std::minstd_rand &gen) const noexcept {
 
   return argmin;
 }
+
+
+int Wave::get_min_entropy_indexed_heap(std::minstd_rand &gen) noexcept {
+  std::uniform_real_distribution<> dis(0, model->min_abs_half_plogp);
+
+  // Update the key of every cell whose entropy changed since the last call.
+  for (unsigned i : changed_cells) {
+    is_changed[i] = 0;
+
+    // Decided cells are not candidates anymore.
+    if (memoisation.nb_patterns[i] == 1) {
+      entropy_heap.remove(i);
+      continue;
+    }
+
+    // The noise is drawn once per change of entropy. Since it is smaller than
+    // the smallest p * log(p), the minimum entropy will always be chosen, and
+    // ties are broken randomly as in the linear scan.
+    entropy_heap.push(i, get_entropy(i) + dis(gen));
+  }
+  changed_cells.clear();
+
+  if (entropy_heap.empty()) {
+    return -1;
+  }
+  return entropy_heap.top();
+}
@@ -1,64 +1,153 @@
 #include "wfc.hpp"
+#include "utils/parallel.hpp"
+
+#include <atomic>
 #include <limits>
 
 namespace {
-  /**
-   * Normalize a vector so the sum of its elements is equal to 1.0f
-   */
-  std::vector<double>& normalize(std::vector<double>& v) {
-    double sum_weights = 0.0;
-    for(double weight: v) {
-      sum_weights += weight;
-    }
 
-    double inv_sum_weights = 1.0/sum_weights;
-    for(double& weight: v) {
-      weight *= inv_sum_weights;
-    }
+/**
+ * The number of elements propagated between two checks of the clock or of the
+ * cancellation of a run.
+ */
+constexpr std::size_t removals_between_checks = 4096;
+
+} // namespace
+
+WFC::WFC(bool periodic_output, int seed,
+         std::vector<double> patterns_frequencies,
+         const Propagator::PropagatorState &propagator, unsigned wave_height,
+         unsigned wave_width, const WFCOptions &options)
+  noexcept
+  : WFC(periodic_output, seed,
+        std::make_shared<const Model>(std::move(patterns_frequencies),
+                                      propagator),
+        wave_height, wave_width, options) {}
 
-    return v;
+WFC::WFC(bool periodic_output, int seed, std::shared_ptr<const Model> model,
+         unsigned wave_height, unsigned wave_width, const WFCOptions &options)
+  noexcept
+  : gen(seed), model(std::move(model)),
+    wave(wave_height, wave_width, this->model, options.min_entropy_search),
+    nb_patterns(this->model->nb_patterns),
+    propagator(wave.height, wave.width, periodic_output, this->model,
+               options.compatible_layout, options.propagation_engine),
+    max_backtracks(options.max_backtracks), nb_backtracks(0) {
+  if (max_backtracks > 0) {
+    wave.set_journaling(true);
   }
 }
 
+void WFC::restore(const Snapshot &snapshot, int seed) noexcept {
+  gen.seed(seed);
+  wave.copy_state(snapshot.wave);
+  propagator.copy_state(snapshot.propagator);
+  decisions = snapshot.decisions;
+  nb_backtracks = snapshot.nb_backtracks;
+}
 
-Array2D<unsigned> WFC::wave_to_output() const noexcept {
-  Array2D<unsigned> output_patterns(wave.height, wave.width);
-  for (unsigned i = 0; i < wave.size; i++) {
-    for (unsigned k = 0; k < nb_patterns; k++) {
-      if (wave.get(i, k)) {
-        output_patterns.data[i] = k;
-      }
-    }
+std::optional<Array2D<unsigned>> WFC::run() noexcept {
+  if (step(std::numeric_limits<std::size_t>::max()) == success) {
+    return wave_to_output();
   }
-  return output_patterns;
+  return std::nullopt;
 }
 
-WFC::WFC(bool periodic_output, int seed,
-         std::vector<double> patterns_frequencies,
-         Propagator::PropagatorState propagator, unsigned wave_height,
-         unsigned wave_width)
-  noexcept
-  : gen(seed), patterns_frequencies(normalize(patterns_frequencies)),
-    wave(wave_height, wave_width, patterns_frequencies),
-    nb_patterns(propagator.size()),
-    propagator(wave.height, wave.width, periodic_output, propagator) {}
+std::optional<Array2D<unsigned>>
+WFC::run(const std::function<bool()> &is_cancelled) noexcept {
+  while (true) {
 
-std::optional<Array2D<unsigned>> WFC::run() noexcept {
+    // Stop if the run is not needed anymore.
+    if (is_cancelled()) {
+      return std::nullopt;
+    }
+
+    ObserveStatus result = step(removals_between_checks);
+    if (result == success) {
+      return wave_to_output();
+    } else if (result == failure) {
+      return std::nullopt;
+    }
+  }
+}
+
+WFC::ObserveStatus WFC::step(std::size_t max_removals) noexcept {
   while (true) {
 
+    // Finish the current propagation first, so the wave is consistent before
+    // the next observation. A contradiction is handled right away, without
+    // propagating the rest of the cascade: the last decision is undone if
+    // possible, and its removal is propagated.
+    PropagationStatus status = propagator.propagate(wave, max_removals);
+    if (status == PropagationStatus::contradiction) {
+      FAST_WFC_STATS(stats.nb_contradictions++;)
+      if (!backtrack()) {
+        return failure;
+      }
+      continue;
+    }
+    if (status == PropagationStatus::paused) {
+      return to_continue;
+    }
+
+    // The budget is checked here, so that a call with a budget of 0 does
+    // nothing.
+    if (max_removals == 0) {
+      return to_continue;
+    }
+
     // Define the value of an undefined cell.
     ObserveStatus result = observe();
 
     // Check if the algorithm has terminated.
     if (result == failure) {
-      return std::nullopt;
+      if (!backtrack()) {
+        return failure;
+      }
     } else if (result == success) {
-      return wave_to_output();
+      return success;
+    }
+  }
+}
+
+WFC::ObserveStatus WFC::run_for(std::chrono::nanoseconds budget) noexcept {
+  const auto deadline = std::chrono::steady_clock::now() + budget;
+  do {
+    ObserveStatus result = step(removals_between_checks);
+    if (result != to_continue) {
+      return result;
+    }
+  } while (std::chrono::steady_clock::now() < deadline);
+  return to_continue;
+}
+
+std::optional<std::pair<int, Array2D<unsigned>>>
+WFC::run_parallel(unsigned n_threads, const std::vector<int> &seeds) const {
+  // The index in seeds of the first seed that succeeded so far, and the
+  // results of the successful attempts.
+  std::atomic<std::size_t> first_success(seeds.size());
+  std::vector<std::optional<Array2D<unsigned>>> results(seeds.size());
+
+  parallel_for(n_threads, seeds.size(), [&](std::size_t i) {
+    // An attempt after a success cannot be the first success.
+    if (first_success.load() < i) {
+      return;
     }
 
-    // Propagate the information.
-    propagator.propagate(wave);
+    WFC attempt = clone(seeds[i]);
+    results[i] = attempt.run([&]() { return first_success.load() < i; });
+    if (results[i].has_value()) {
+      std::size_t current = first_success.load();
+      while (i < current && !first_success.compare_exchange_weak(current, i)) {
+      }
+    }
+  });
+
+  std::size_t i = first_success.load();
+  if (i == seeds.size()) {
+    return std::nullopt;
   }
+  return std::make_pair(seeds[i], std::move(*results[i]));
 }
 
 
@@ -68,42 +157,78 @@ WFC::ObserveStatus WFC::observe() noexcept {
 
     // If there is a contradiction, the algorithm has failed.
     if (argmin == -2) {
+      FAST_WFC_STATS(stats.nb_contradictions++;)
       return failure;
     }
 
     // If the lowest entropy is 0, then the algorithm has succeeded and
     // finished.
     if (argmin == -1) {
-      wave_to_output();
       return success;
     }
 
     // Choose an element according to the pattern distribution
     double s = 0;
-    for (unsigned k = 0; k < nb_patterns; k++) {
-      s += wave.get(argmin, k) ? patterns_frequencies[k] : 0;
-    }
+    wave.for_each(argmin,
+                  [&](unsigned k) { s += model->patterns_frequencies[k]; });
 
     std::uniform_real_distribution<> dis(0, s);
     double random_value = dis(gen);
-    size_t chosen_value = nb_patterns - 1;
-
-    for (unsigned k = 0; k < nb_patterns; k++) {
-      random_value -= wave.get(argmin, k) ? patterns_frequencies[k] : 0;
-      if (random_value <= 0) {
+    unsigned chosen_value = wave.first(argmin);
+
+    // The chosen pattern is the first one for which the cumulated frequencies
+    // reach random_value (or the last one, because of rounding errors). The
+    // draw can be exactly 0, in which case it is the first pattern of the
+    // cell.
+    wave.for_each(argmin, [&](unsigned k) {
+      if (random_value > 0) {
+        random_value -= model->patterns_frequencies[k];
         chosen_value = k;
-        break;
       }
+    });
+
+    // Record the decision so it can be undone. The removals done before the
+    // first decision are never undone.
+    if (max_backtracks > 0) {
+      if (decisions.empty()) {
+        wave.clear_journal();
+      }
+      decisions.push_back({wave.get_journal_size(),
+                           static_cast<unsigned>(argmin), chosen_value});
     }
 
     // And define the cell with the pattern.
-    for (unsigned k = 0; k < nb_patterns; k++) {
-      if (wave.get(argmin, k) != (k == chosen_value)) {
+    FAST_WFC_STATS(stats.nb_observations++;)
+    wave.for_each(argmin, [&](unsigned k) {
+      if (k != chosen_value) {
         propagator.add_to_propagator(argmin / wave.width, argmin % wave.width,
                                      k);
         wave.set(argmin, k, false);
       }
-    }
+    });
 
     return to_continue;
   }
+
+
+bool WFC::backtrack() noexcept {
+  if (decisions.empty() || nb_backtracks == max_backtracks) {
+    return false;
+  }
+  nb_backtracks++;
+  Decision decision = decisions.back();
+  decisions.pop_back();
+
+  // Put back every pattern removed since the decision, and the counts of the
+  // propagator with them.
+  propagator.clear();
+  wave.undo(decision.journal_size, [&](unsigned index, unsigned pattern) {
+    propagator.restore(index / wave.width, index % wave.width, pattern);
+  });
+
+  // The chosen pattern leads to a contradiction, so it is removed.
+  propagator.add_to_propagator(decision.cell / wave.width,
+                               decision.cell % wave.width, decision.pattern);
+  wave.set(decision.cell, decision.pattern, false);
+  return true;
+}